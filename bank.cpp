@@ -1,942 +1,7797 @@
-#include <iostream>
-#include <string>
-#include <vector>
-#include <memory>
-#include <map>
-#include <fstream>
-#include <iomanip>
-#include <algorithm>
-#include <chrono>
-#include <sstream>
-#include<bits/stdc++.h>
-using namespace std;
-
-// Forward declarations
-class Transaction;
-class Account;
-class Customer;
-class Bank;
-
-// Enum for transaction types
-enum class TransactionType {
-    DEPOSIT,
-    WITHDRAWAL,
-    TRANSFER,
-    LOAN_PAYMENT,
-    INTEREST_CREDIT
-};
-
-// Enum for account types
-enum class AccountType {
-    SAVINGS,
-    CHECKING,
-    LOAN,
-    FIXED_DEPOSIT
-};
-
-// Base Exception class for custom exceptions
-class BankException : public exception {
-private:
-    string message;
-public:
-    BankException(const string& msg) : message(msg) {}
-    const char* what() const noexcept override {
-        return message.c_str();
-    }
-};
-
-// Custom exceptions
-class InsufficientFundsException : public BankException {
-public:
-    InsufficientFundsException() : BankException("Insufficient funds in account") {}
-};
-
-class AccountNotFoundException : public BankException {
-public:
-    AccountNotFoundException() : BankException("Account not found") {}
-};
-
-class InvalidAmountException : public BankException {
-public:
-    InvalidAmountException() : BankException("Invalid amount specified") {}
-};
-
-// Transaction class to record all transactions
-class Transaction {
-private:
-    static int nextTransactionId;
-    int transactionId;
-    string fromAccountId;
-    string toAccountId;
-    double amount;
-    TransactionType type;
-    string timestamp;
-    string description;
-
-public:
-    Transaction(const string& from, const string& to, double amt, 
-                TransactionType t, const string& desc = "")
-        : transactionId(++nextTransactionId), fromAccountId(from), 
-          toAccountId(to), amount(amt), type(t), description(desc) {
-        
-        auto now = chrono::system_clock::now();
-        auto time_t = chrono::system_clock::to_time_t(now);
-        stringstream ss;
-        ss << put_time(localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-        timestamp = ss.str();
-    }
-
-    // Getters
-    int getTransactionId() const { return transactionId; }
-    string getFromAccountId() const { return fromAccountId; }
-    string getToAccountId() const { return toAccountId; }
-    double getAmount() const { return amount; }
-    TransactionType getType() const { return type; }
-    string getTimestamp() const { return timestamp; }
-    string getDescription() const { return description; }
-
-    string getTypeString() const {
-        switch(type) {
-            case TransactionType::DEPOSIT: return "DEPOSIT";
-            case TransactionType::WITHDRAWAL: return "WITHDRAWAL";
-            case TransactionType::TRANSFER: return "TRANSFER";
-            case TransactionType::LOAN_PAYMENT: return "LOAN_PAYMENT";
-            case TransactionType::INTEREST_CREDIT: return "INTEREST_CREDIT";
-            default: return "UNKNOWN";
-        }
-    }
-
-    void display() const {
-        cout << "ID: " << transactionId 
-             << " | Type: " << getTypeString()
-             << " | Amount: $" << fixed << setprecision(2) << amount
-             << " | Time: " << timestamp
-             << " | From: " << fromAccountId
-             << " | To: " << toAccountId
-             << " | Desc: " << description << endl;
-    }
-};
-
-// Initialize static member
-int Transaction::nextTransactionId = 0;
-
-// Abstract base class for all accounts
-class Account {
-protected:
-    string accountId;
-    string customerId;
-    double balance;
-    AccountType accountType;
-    string creationDate;
-    bool isActive;
-    vector<shared_ptr<Transaction>> transactionHistory;
-
-public:
-    Account(const string& accId, const string& custId, double initialBalance, AccountType type)
-        : accountId(accId), customerId(custId), balance(initialBalance), 
-          accountType(type), isActive(true) {
-        
-        auto now = chrono::system_clock::now();
-        auto time_t = chrono::system_clock::to_time_t(now);
-        stringstream ss;
-        ss << put_time(localtime(&time_t), "%Y-%m-%d");
-        creationDate = ss.str();
-    }
-
-    virtual ~Account() = default;
-
-    // Pure virtual functions
-    virtual void deposit(double amount) = 0;
-    virtual bool withdraw(double amount) = 0;
-    virtual void calculateInterest() = 0;
-    virtual string getAccountTypeString() const = 0;
-    virtual void displayAccountInfo() const = 0;
-
-    // Getters
-    string getAccountId() const { return accountId; }
-    string getCustomerId() const { return customerId; }
-    double getBalance() const { return balance; }
-    AccountType getAccountType() const { return accountType; }
-    string getCreationDate() const { return creationDate; }
-    bool getIsActive() const { return isActive; }
-
-    // Common methods
-    void addTransaction(shared_ptr<Transaction> transaction) {
-        transactionHistory.push_back(transaction);
-    }
-
-    void displayTransactionHistory() const {
-        cout << "\n=== Transaction History for Account: " << accountId << " ===" << endl;
-        if (transactionHistory.empty()) {
-            cout << "No transactions found." << endl;
-            return;
-        }
-        
-        for (const auto& transaction : transactionHistory) {
-            transaction->display();
-        }
-    }
-
-    void closeAccount() {
-        isActive = false;
-        cout << "Account " << accountId << " has been closed." << endl;
-    }
-
-protected:
-    void setBalance(double newBalance) { balance = newBalance; }
-};
-
-// Savings Account class
-class SavingsAccount : public Account {
-private:
-    double interestRate;
-    double minimumBalance;
-
-public:
-    SavingsAccount(const string& accId, const string& custId, double initialBalance)
-        : Account(accId, custId, initialBalance, AccountType::SAVINGS),
-          interestRate(0.035), minimumBalance(100.0) {}
-
-    void deposit(double amount) override {
-        if (amount <= 0) {
-            throw InvalidAmountException();
-        }
-        balance += amount;
-        cout << "Deposited $" << fixed << setprecision(2) << amount 
-             << " to Savings Account. New balance: $" << balance << endl;
-    }
-
-    bool withdraw(double amount) override {
-        if (amount <= 0) {
-            throw InvalidAmountException();
-        }
-        if (balance - amount < minimumBalance) {
-            throw InsufficientFundsException();
-        }
-        balance -= amount;
-        cout << "Withdrew $" << fixed << setprecision(2) << amount 
-             << " from Savings Account. New balance: $" << balance << endl;
-        return true;
-    }
-
-    void calculateInterest() override {
-        double interest = balance * interestRate / 12; // Monthly interest
-        balance += interest;
-        cout << "Interest of $" << fixed << setprecision(2) << interest 
-             << " credited to Savings Account. New balance: $" << balance << endl;
-    }
-
-    string getAccountTypeString() const override {
-        return "SAVINGS";
-    }
-
-    void displayAccountInfo() const override {
-        cout << "\n=== Savings Account Information ===" << endl;
-        cout << "Account ID: " << accountId << endl;
-        cout << "Customer ID: " << customerId << endl;
-        cout << "Balance: $" << fixed << setprecision(2) << balance << endl;
-        cout << "Interest Rate: " << fixed << setprecision(1) << interestRate * 100 << "%" << endl;
-        cout << "Minimum Balance: $" << fixed << setprecision(2) << minimumBalance << endl;
-        cout << "Creation Date: " << creationDate << endl;
-        cout << "Status: " << (isActive ? "Active" : "Closed") << endl;
-    }
-};
-
-// Checking Account class
-class CheckingAccount : public Account {
-private:
-    double overdraftLimit;
-    double overdraftFee;
-
-public:
-    CheckingAccount(const string& accId, const string& custId, double initialBalance)
-        : Account(accId, custId, initialBalance, AccountType::CHECKING),
-          overdraftLimit(500.0), overdraftFee(35.0) {}
-
-    void deposit(double amount) override {
-        if (amount <= 0) {
-            throw InvalidAmountException();
-        }
-        balance += amount;
-        cout << "Deposited $" << fixed << setprecision(2) << amount 
-             << " to Checking Account. New balance: $" << balance << endl;
-    }
-
-    bool withdraw(double amount) override {
-        if (amount <= 0) {
-            throw InvalidAmountException();
-        }
-        if (balance - amount < -overdraftLimit) {
-            throw InsufficientFundsException();
-        }
-        
-        balance -= amount;
-        if (balance < 0) {
-            balance -= overdraftFee;
-            cout << "Overdraft fee of $" << fixed << setprecision(2) << overdraftFee << " applied." << endl;
-        }
-        
-        cout << "Withdrew $" << fixed << setprecision(2) << amount 
-             << " from Checking Account. New balance: $" << balance << endl;
-        return true;
-    }
-
-    void calculateInterest() override {
-        // Checking accounts typically don't earn interest
-        // But we can implement a small interest rate for positive balances
-        if (balance > 0) {
-            double interest = balance * 0.001 / 12; // 0.1% annual rate
-            balance += interest;
-            cout << "Interest of $" << fixed << setprecision(2) << interest 
-                 << " credited to Checking Account. New balance: $" << balance << endl;
-        }
-    }
-
-    string getAccountTypeString() const override {
-        return "CHECKING";
-    }
-
-    void displayAccountInfo() const override {
-        cout << "\n=== Checking Account Information ===" << endl;
-        cout << "Account ID: " << accountId << endl;
-        cout << "Customer ID: " << customerId << endl;
-        cout << "Balance: $" << fixed << setprecision(2) << balance << endl;
-        cout << "Overdraft Limit: $" << fixed << setprecision(2) << overdraftLimit << endl;
-        cout << "Overdraft Fee: $" << fixed << setprecision(2) << overdraftFee << endl;
-        cout << "Creation Date: " << creationDate << endl;
-        cout << "Status: " << (isActive ? "Active" : "Closed") << endl;
-    }
-};
-
-// Loan Account class
-class LoanAccount : public Account {
-private:
-    double loanAmount;
-    double interestRate;
-    int termMonths;
-    double monthlyPayment;
-
-public:
-    LoanAccount(const string& accId, const string& custId, double loanAmt, int term)
-        : Account(accId, custId, -loanAmt, AccountType::LOAN),
-          loanAmount(loanAmt), interestRate(0.065), termMonths(term) {
-        
-        // Calculate monthly payment using loan formula
-        double monthlyRate = interestRate / 12;
-        monthlyPayment = (loanAmt * monthlyRate * pow(1 + monthlyRate, termMonths)) /
-                        (pow(1 + monthlyRate, termMonths) - 1);
-    }
-
-    void deposit(double amount) override {
-        if (amount <= 0) {
-            throw InvalidAmountException();
-        }
-        balance += amount; // Balance is negative for loans, so this reduces debt
-        cout << "Payment of $" << fixed << setprecision(2) << amount 
-             << " applied to Loan Account. Remaining balance: $" << abs(balance) << endl;
-    }
-
-    bool withdraw(double amount) override {
-        cout << "Withdrawals not allowed on loan accounts." << endl;
-        return false;
-    }
-
-    void calculateInterest() override {
-        double interest = abs(balance) * interestRate / 12; // Monthly interest on remaining balance
-        balance -= interest; // Increases debt
-        cout << "Interest of $" << fixed << setprecision(2) << interest 
-             << " applied to Loan Account. Remaining balance: $" << abs(balance) << endl;
-    }
-
-    string getAccountTypeString() const override {
-        return "LOAN";
-    }
-
-    double getMonthlyPayment() const { return monthlyPayment; }
-
-    void displayAccountInfo() const override {
-        cout << "\n=== Loan Account Information ===" << endl;
-        cout << "Account ID: " << accountId << endl;
-        cout << "Customer ID: " << customerId << endl;
-        cout << "Original Loan Amount: $" << fixed << setprecision(2) << loanAmount << endl;
-        cout << "Remaining Balance: $" << fixed << setprecision(2) << abs(balance) << endl;
-        cout << "Interest Rate: " << fixed << setprecision(1) << interestRate * 100 << "%" << endl;
-        cout << "Term: " << termMonths << " months" << endl;
-        cout << "Monthly Payment: $" << fixed << setprecision(2) << monthlyPayment << endl;
-        cout << "Creation Date: " << creationDate << endl;
-        cout << "Status: " << (isActive ? "Active" : "Closed") << endl;
-    }
-};
-
-// Customer class
-class Customer {
-private:
-    string customerId;
-    string firstName;
-    string lastName;
-    string email;
-    string phone;
-    string address;
-    vector<string> accountIds;
-
-public:
-    Customer(const string& id, const string& fname, const string& lname,
-             const string& email, const string& phone, const string& addr)
-        : customerId(id), firstName(fname), lastName(lname),
-          email(email), phone(phone), address(addr) {}
-
-    // Getters
-    string getCustomerId() const { return customerId; }
-    string getFirstName() const { return firstName; }
-    string getLastName() const { return lastName; }
-    string getFullName() const { return firstName + " " + lastName; }
-    string getEmail() const { return email; }
-    string getPhone() const { return phone; }
-    string getAddress() const { return address; }
-    vector<string> getAccountIds() const { return accountIds; }
-
-    // Methods
-    void addAccount(const string& accountId) {
-        accountIds.push_back(accountId);
-    }
-
-    void removeAccount(const string& accountId) {
-        accountIds.erase(remove(accountIds.begin(), accountIds.end(), accountId), accountIds.end());
-    }
-
-    void displayCustomerInfo() const {
-        cout << "\n=== Customer Information ===" << endl;
-        cout << "Customer ID: " << customerId << endl;
-        cout << "Name: " << getFullName() << endl;
-        cout << "Email: " << email << endl;
-        cout << "Phone: " << phone << endl;
-        cout << "Address: " << address << endl;
-        cout << "Number of Accounts: " << accountIds.size() << endl;
-        
-        if (!accountIds.empty()) {
-            cout << "Account IDs: ";
-            for (size_t i = 0; i < accountIds.size(); ++i) {
-                cout << accountIds[i];
-                if (i < accountIds.size() - 1) cout << ", ";
-            }
-            cout << endl;
-        }
-    }
-
-    // Setters for updating customer information
-    void setEmail(const string& newEmail) { email = newEmail; }
-    void setPhone(const string& newPhone) { phone = newPhone; }
-    void setAddress(const string& newAddress) { address = newAddress; }
-};
-
-// Bank class - Main management class
-class Bank {
-private:
-    string bankName;
-    map<string, shared_ptr<Customer>> customers;
-    map<string, shared_ptr<Account>> accounts;
-    vector<shared_ptr<Transaction>> allTransactions;
-    int nextCustomerId;
-    int nextAccountId;
-
-public:
-    Bank(const string& name) : bankName(name), nextCustomerId(1000), nextAccountId(10000) {}
-
-    // Customer management
-    string createCustomer(const string& firstName, const string& lastName,
-                         const string& email, const string& phone, const string& address) {
-        string customerId = "CUST" + to_string(++nextCustomerId);
-        auto customer = make_shared<Customer>(customerId, firstName, lastName, email, phone, address);
-        customers[customerId] = customer;
-        
-        cout << "Customer created successfully with ID: " << customerId << endl;
-        return customerId;
-    }
-
-    shared_ptr<Customer> findCustomer(const string& customerId) {
-        auto it = customers.find(customerId);
-        if (it != customers.end()) {
-            return it->second;
-        }
-        return nullptr;
-    }
-
-    // Account management
-    string createSavingsAccount(const string& customerId, double initialDeposit) {
-        auto customer = findCustomer(customerId);
-        if (!customer) {
-            throw AccountNotFoundException();
-        }
-
-        string accountId = "SAV" + to_string(++nextAccountId);
-        auto account = make_shared<SavingsAccount>(accountId, customerId, initialDeposit);
-        accounts[accountId] = account;
-        customer->addAccount(accountId);
-
-        // Create initial deposit transaction
-        auto transaction = make_shared<Transaction>("BANK", accountId, initialDeposit, 
-                                                   TransactionType::DEPOSIT, "Initial deposit");
-        account->addTransaction(transaction);
-        allTransactions.push_back(transaction);
-
-        cout << "Savings account created successfully with ID: " << accountId << endl;
-        return accountId;
-    }
-
-    string createCheckingAccount(const string& customerId, double initialDeposit) {
-        auto customer = findCustomer(customerId);
-        if (!customer) {
-            throw AccountNotFoundException();
-        }
-
-        string accountId = "CHK" + to_string(++nextAccountId);
-        auto account = make_shared<CheckingAccount>(accountId, customerId, initialDeposit);
-        accounts[accountId] = account;
-        customer->addAccount(accountId);
-
-        // Create initial deposit transaction
-        auto transaction = make_shared<Transaction>("BANK", accountId, initialDeposit, 
-                                                   TransactionType::DEPOSIT, "Initial deposit");
-        account->addTransaction(transaction);
-        allTransactions.push_back(transaction);
-
-        cout << "Checking account created successfully with ID: " << accountId << endl;
-        return accountId;
-    }
-
-    string createLoanAccount(const string& customerId, double loanAmount, int termMonths) {
-        auto customer = findCustomer(customerId);
-        if (!customer) {
-            throw AccountNotFoundException();
-        }
-
-        string accountId = "LOAN" + to_string(++nextAccountId);
-        auto account = make_shared<LoanAccount>(accountId, customerId, loanAmount, termMonths);
-        accounts[accountId] = account;
-        customer->addAccount(accountId);
-
-        // Create initial loan transaction
-        auto transaction = make_shared<Transaction>("BANK", accountId, loanAmount, 
-                                                   TransactionType::DEPOSIT, "Loan disbursement");
-        account->addTransaction(transaction);
-        allTransactions.push_back(transaction);
-
-        cout << "Loan account created successfully with ID: " << accountId << endl;
-        return accountId;
-    }
-
-    shared_ptr<Account> findAccount(const string& accountId) {
-        auto it = accounts.find(accountId);
-        if (it != accounts.end()) {
-            return it->second;
-        }
-        return nullptr;
-    }
-
-    // Transaction operations
-    void deposit(const string& accountId, double amount) {
-        auto account = findAccount(accountId);
-        if (!account) {
-            throw AccountNotFoundException();
-        }
-
-        account->deposit(amount);
-
-        // Record transaction
-        auto transaction = make_shared<Transaction>("EXTERNAL", accountId, amount, 
-                                                   TransactionType::DEPOSIT);
-        account->addTransaction(transaction);
-        allTransactions.push_back(transaction);
-    }
-
-    void withdraw(const string& accountId, double amount) {
-        auto account = findAccount(accountId);
-        if (!account) {
-            throw AccountNotFoundException();
-        }
-
-        if (account->withdraw(amount)) {
-            // Record transaction
-            auto transaction = make_shared<Transaction>(accountId, "EXTERNAL", amount, 
-                                                       TransactionType::WITHDRAWAL);
-            account->addTransaction(transaction);
-            allTransactions.push_back(transaction);
-        }
-    }
-
-    void transfer(const string& fromAccountId, const string& toAccountId, double amount) {
-        auto fromAccount = findAccount(fromAccountId);
-        auto toAccount = findAccount(toAccountId);
-
-        if (!fromAccount || !toAccount) {
-            throw AccountNotFoundException();
-        }
-
-        if (fromAccount->withdraw(amount)) {
-            toAccount->deposit(amount);
-
-            // Record transaction for both accounts
-            auto transaction = make_shared<Transaction>(fromAccountId, toAccountId, amount, 
-                                                       TransactionType::TRANSFER);
-            fromAccount->addTransaction(transaction);
-            toAccount->addTransaction(transaction);
-            allTransactions.push_back(transaction);
-
-            cout << "Transfer of $" << fixed << setprecision(2) << amount 
-                 << " completed from " << fromAccountId << " to " << toAccountId << endl;
-        }
-    }
-
-    // Reporting and display methods
-    void displayAllCustomers() const {
-        cout << "\n=== All Customers ===" << endl;
-        if (customers.empty()) {
-            cout << "No customers found." << endl;
-            return;
-        }
-
-        for (const auto& pair : customers) {
-            pair.second->displayCustomerInfo();
-            cout << "------------------------" << endl;
-        }
-    }
-
-    void displayAllAccounts() const {
-        cout << "\n=== All Accounts ===" << endl;
-        if (accounts.empty()) {
-            cout << "No accounts found." << endl;
-            return;
-        }
-
-        for (const auto& pair : accounts) {
-            pair.second->displayAccountInfo();
-            cout << "------------------------" << endl;
-        }
-    }
-
-    void displayCustomerAccounts(const string& customerId) const {
-        auto customer = customers.find(customerId);
-        if (customer == customers.end()) {
-            cout << "Customer not found." << endl;
-            return;
-        }
-
-        cout << "\n=== Accounts for Customer: " << customer->second->getFullName() << " ===" << endl;
-        auto accountIds = customer->second->getAccountIds();
-        
-        if (accountIds.empty()) {
-            cout << "No accounts found for this customer." << endl;
-            return;
-        }
-
-        for (const string& accId : accountIds) {
-            auto account = accounts.find(accId);
-            if (account != accounts.end()) {
-                account->second->displayAccountInfo();
-                cout << "------------------------" << endl;
-            }
-        }
-    }
-
-    void generateBankReport() const {
-        cout << "\n========== BANK REPORT ==========" << endl;
-        cout << "Bank Name: " << bankName << endl;
-        cout << "Total Customers: " << customers.size() << endl;
-        cout << "Total Accounts: " << accounts.size() << endl;
-        cout << "Total Transactions: " << allTransactions.size() << endl;
-
-        double totalDeposits = 0;
-        int savingsCount = 0, checkingCount = 0, loanCount = 0;
-
-        for (const auto& pair : accounts) {
-            auto account = pair.second;
-            if (account->getAccountType() == AccountType::SAVINGS) {
-                savingsCount++;
-                totalDeposits += account->getBalance();
-            } else if (account->getAccountType() == AccountType::CHECKING) {
-                checkingCount++;
-                totalDeposits += account->getBalance();
-            } else if (account->getAccountType() == AccountType::LOAN) {
-                loanCount++;
-            }
-        }
-
-        cout << "Savings Accounts: " << savingsCount << endl;
-        cout << "Checking Accounts: " << checkingCount << endl;
-        cout << "Loan Accounts: " << loanCount << endl;
-        cout << "Total Deposits: $" << fixed << setprecision(2) << totalDeposits << endl;
-        cout << "=================================" << endl;
-    }
-
-    // Monthly operations
-    void processMonthlyInterest() {
-        cout << "\n=== Processing Monthly Interest ===" << endl;
-        for (const auto& pair : accounts) {
-            auto account = pair.second;
-            if (account->getIsActive()) {
-                cout << "Processing account: " << account->getAccountId() << endl;
-                account->calculateInterest();
-                
-                // Record interest transaction
-                auto transaction = make_shared<Transaction>("BANK", account->getAccountId(), 0, 
-                                                           TransactionType::INTEREST_CREDIT, "Monthly interest");
-                account->addTransaction(transaction);
-                allTransactions.push_back(transaction);
-                cout << "------------------------" << endl;
-            }
-        }
-    }
-
-    // Save and load functionality
-    void saveToFile(const string& filename) const {
-        ofstream file(filename);
-        if (!file.is_open()) {
-            cout << "Error opening file for writing." << endl;
-            return;
-        }
-
-        file << "=== BANK DATA EXPORT ===" << endl;
-        file << "Bank Name: " << bankName << endl;
-        file << "Export Date: ";
-        
-        auto now = chrono::system_clock::now();
-        auto time_t = chrono::system_clock::to_time_t(now);
-        file << put_time(localtime(&time_t), "%Y-%m-%d %H:%M:%S") << endl;
-        
-        file << "\n=== CUSTOMERS ===" << endl;
-        for (const auto& pair : customers) {
-            auto customer = pair.second;
-            file << customer->getCustomerId() << "|" 
-                 << customer->getFirstName() << "|"
-                 << customer->getLastName() << "|"
-                 << customer->getEmail() << "|"
-                 << customer->getPhone() << "|"
-                 << customer->getAddress() << endl;
-        }
-
-        file << "\n=== ACCOUNTS ===" << endl;
-        for (const auto& pair : accounts) {
-            auto account = pair.second;
-            file << account->getAccountId() << "|"
-                 << account->getCustomerId() << "|"
-                 << account->getAccountTypeString() << "|"
-                 << account->getBalance() << "|"
-                 << account->getCreationDate() << "|"
-                 << (account->getIsActive() ? "ACTIVE" : "CLOSED") << endl;
-        }
-
-        file.close();
-        cout << "Bank data saved to " << filename << endl;
-    }
-};
-
-// Utility functions for the menu system
-void displayMainMenu() {
-    cout << "\n========== BANK MANAGEMENT SYSTEM ==========" << endl;
-    cout << "1.  Create Customer" << endl;
-    cout << "2.  Create Savings Account" << endl;
-    cout << "3.  Create Checking Account" << endl;
-    cout << "4.  Create Loan Account" << endl;
-    cout << "5.  Deposit Money" << endl;
-    cout << "6.  Withdraw Money" << endl;
-    cout << "7.  Transfer Money" << endl;
-    cout << "8.  View Customer Information" << endl;
-    cout << "9.  View Account Information" << endl;
-    cout << "10. View Customer Accounts" << endl;
-    cout << "11. View Transaction History" << endl;
-    cout << "12. View All Customers" << endl;
-    cout << "13. View All Accounts" << endl;
-    cout << "14. Process Monthly Interest" << endl;
-    cout << "15. Generate Bank Report" << endl;
-    cout << "16. Save Data to File" << endl;
-    cout << "0.  Exit" << endl;
-    cout << "=============================================" << endl;
-    cout << "Choose an option: ";
-}
-
-// Main function with menu-driven interface
-int main() {
-    Bank bank("First National Bank");
-    int choice;
-    string customerId, accountId, fromAccount, toAccount;
-    double amount;
-    
-    cout << "Welcome to the Bank Management System!" << endl;
-
-    while (true) {
-        try {
-            displayMainMenu();
-            cin >> choice;
-
-            switch (choice) {
-                case 1: {
-                    string firstName, lastName, email, phone, address;
-                    cout << "Enter first name: ";
-                    cin >> firstName;
-                    cout << "Enter last name: ";
-                    cin >> lastName;
-                    cout << "Enter email: ";
-                    cin >> email;
-                    cout << "Enter phone: ";
-                    cin >> phone;
-                    cout << "Enter address: ";
-                    cin.ignore();
-                    getline(cin, address);
-                    
-                    customerId = bank.createCustomer(firstName, lastName, email, phone, address);
-                    break;
-                }
-                case 2: {
-                    cout << "Enter customer ID: ";
-                    cin >> customerId;
-                    cout << "Enter initial deposit: $";
-                    cin >> amount;
-                    
-                    bank.createSavingsAccount(customerId, amount);
-                    break;
-                }
-                case 3: {
-                    cout << "Enter customer ID: ";
-                    cin >> customerId;
-                    cout << "Enter initial deposit: $";
-                    cin >> amount;
-                    
-                    bank.createCheckingAccount(customerId, amount);
-                    break;
-                }
-                case 4: {
-                    cout << "Enter customer ID: ";
-                    cin >> customerId;
-                    cout << "Enter loan amount: $";
-                    cin >> amount;
-                    int term;
-                    cout << "Enter loan term (months): ";
-                    cin >> term;
-                    
-                    bank.createLoanAccount(customerId, amount, term);
-                    break;
-                }
-                case 5: {
-                    cout << "Enter account ID: ";
-                    cin >> accountId;
-                    cout << "Enter deposit amount: $";
-                    cin >> amount;
-                    
-                    bank.deposit(accountId, amount);
-                    break;
-                }
-                case 6: {
-                    cout << "Enter account ID: ";
-                    cin >> accountId;
-                    cout << "Enter withdrawal amount: $";
-                    cin >> amount;
-                    
-                    bank.withdraw(accountId, amount);
-                    break;
-                }
-                case 7: {
-                    cout << "Enter from account ID: ";
-                    cin >> fromAccount;
-                    cout << "Enter to account ID: ";
-                    cin >> toAccount;
-                    cout << "Enter transfer amount: $";
-                    cin >> amount;
-                    
-                    bank.transfer(fromAccount, toAccount, amount);
-                    break;
-                }
-                case 8: {
-                    cout << "Enter customer ID: ";
-                    cin >> customerId;
-                    
-                    auto customer = bank.findCustomer(customerId);
-                    if (customer) {
-                        customer->displayCustomerInfo();
-                    } else {
-                        cout << "Customer not found." << endl;
-                    }
-                    break;
-                }
-                case 9: {
-                    cout << "Enter account ID: ";
-                    cin >> accountId;
-                    
-                    auto account = bank.findAccount(accountId);
-                    if (account) {
-                        account->displayAccountInfo();
-                    } else {
-                        cout << "Account not found." << endl;
-                    }
-                    break;
-                }
-                case 10: {
-                    cout << "Enter customer ID: ";
-                    cin >> customerId;
-                    
-                    bank.displayCustomerAccounts(customerId);
-                    break;
-                }
-                case 11: {
-                    cout << "Enter account ID: ";
-                    cin >> accountId;
-                    
-                    auto account = bank.findAccount(accountId);
-                    if (account) {
-                        account->displayTransactionHistory();
-                    } else {
-                        cout << "Account not found." << endl;
-                    }
-                    break;
-                }
-                case 12: {
-                    bank.displayAllCustomers();
-                    break;
-                }
-                case 13: {
-                    bank.displayAllAccounts();
-                    break;
-                }
-                case 14: {
-                    bank.processMonthlyInterest();
-                    break;
-                }
-                case 15: {
-                    bank.generateBankReport();
-                    break;
-                }
-                case 16: {
-                    string filename;
-                    cout << "Enter filename: ";
-                    cin >> filename;
-                    bank.saveToFile(filename);
-                    break;
-                }
-                case 0: {
-                    cout << "Thank you for using Bank Management System!" << endl;
-                    cout << "Goodbye!" << endl;
-                    return 0;
-                }
-                default: {
-                    cout << "Invalid choice. Please try again." << endl;
-                    break;
-                }
-            }
-        }
-        catch (const BankException& e) {
-            cout << "Bank Error: " << e.what() << endl;
-        }
-        catch (const exception& e) {
-            cout << "System Error: " << e.what() << endl;
-        }
-        catch (...) {
-            cout << "Unknown error occurred. Please try again." << endl;
-        }
-
-        // Pause before showing menu again
-        cout << "\nPress Enter to continue...";
-        cin.ignore();
-        cin.get();
-    }
-
-    return 0;
-}
\ No newline at end of file
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include<bits/stdc++.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+using namespace std;
+
+// Forward declarations
+class Transaction;
+class TransactionLedger;
+class Account;
+class Customer;
+class CustomerIndex;
+class Bank;
+
+// Enum for transaction types
+enum class TransactionType {
+    DEPOSIT,
+    WITHDRAWAL,
+    TRANSFER,
+    LOAN_PAYMENT,
+    INTEREST_CREDIT,
+    INTEREST_CHARGE,
+    FEE,
+    LOAN_DISBURSEMENT
+};
+
+const size_t transactionTypeCount = 8;
+
+// Enum for account types
+enum class AccountType {
+    SAVINGS,
+    CHECKING,
+    LOAN,
+    FIXED_DEPOSIT
+};
+
+// Outcome of the non-throwing operations (Bank::tryWithdraw and friends); each
+// failure stands for the exception the throwing API raises in its place
+enum class OperationStatus : uint8_t {
+    OK,
+    INSUFFICIENT_FUNDS,
+    ACCOUNT_NOT_FOUND,
+    INVALID_AMOUNT,
+    REFUSED // the account type does not allow it (withdrawals from a loan)
+};
+
+inline const char* statusMessage(OperationStatus status) {
+    switch (status) {
+        case OperationStatus::OK: return "OK";
+        case OperationStatus::INSUFFICIENT_FUNDS: return "Insufficient funds in account";
+        case OperationStatus::ACCOUNT_NOT_FOUND: return "Account not found";
+        case OperationStatus::INVALID_AMOUNT: return "Invalid amount specified";
+        case OperationStatus::REFUSED: return "Operation not allowed for this account type";
+    }
+    return "Unknown status";
+}
+
+// Base Exception class for custom exceptions
+class BankException : public exception {
+private:
+    string message;
+public:
+    BankException(const string& msg) : message(msg) {}
+    const char* what() const noexcept override {
+        return message.c_str();
+    }
+};
+
+// Custom exceptions
+class InsufficientFundsException : public BankException {
+public:
+    InsufficientFundsException() : BankException(statusMessage(OperationStatus::INSUFFICIENT_FUNDS)) {}
+};
+
+class AccountNotFoundException : public BankException {
+public:
+    AccountNotFoundException() : BankException(statusMessage(OperationStatus::ACCOUNT_NOT_FOUND)) {}
+};
+
+class InvalidAmountException : public BankException {
+public:
+    InvalidAmountException() : BankException(statusMessage(OperationStatus::INVALID_AMOUNT)) {}
+};
+
+class OperationRefusedException : public BankException {
+public:
+    OperationRefusedException() : BankException(statusMessage(OperationStatus::REFUSED)) {}
+};
+
+// Raised when one transfer of a batch fails; none of the batch is applied
+class BatchTransferException : public BankException {
+private:
+    size_t failedTransfer;
+public:
+    BatchTransferException(size_t transfer, const string& reason)
+        : BankException("Transfer " + to_string(transfer + 1) + " of batch failed: " + reason),
+          failedTransfer(transfer) {}
+    size_t getFailedTransfer() const { return failedTransfer; }
+};
+
+// Throws the exception a failed status stands for
+inline void throwOnFailure(OperationStatus status) {
+    switch (status) {
+        case OperationStatus::OK: return;
+        case OperationStatus::INSUFFICIENT_FUNDS: throw InsufficientFundsException();
+        case OperationStatus::ACCOUNT_NOT_FOUND: throw AccountNotFoundException();
+        case OperationStatus::INVALID_AMOUNT: throw InvalidAmountException();
+        case OperationStatus::REFUSED: throw OperationRefusedException();
+    }
+}
+
+// Money class - fixed-point currency amount held as int64 cents
+// Conversions from decimal text are exact; conversions from double and rate
+// applications round half away from zero to the nearest cent.
+class Money {
+private:
+    int64_t cents;
+
+    static int64_t divideRounded(__int128 numerator, int64_t denominator) {
+        __int128 half = denominator / 2;
+        return static_cast<int64_t>(numerator >= 0 ? (numerator + half) / denominator
+                                                   : -((-numerator + half) / denominator));
+    }
+
+public:
+    constexpr Money() : cents(0) {}
+
+    static constexpr Money fromCents(int64_t value) {
+        Money money;
+        money.cents = value;
+        return money;
+    }
+
+    static Money fromDouble(double value) {
+        return fromCents(llround(value * 100.0));
+    }
+
+    // Parses "123", "-4.5", "0.07"; digits beyond the cents are rounded
+    static bool parse(string_view text, Money& result) {
+        size_t pos = 0;
+        bool negative = false;
+        if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+            negative = text[pos] == '-';
+            pos++;
+        }
+        int64_t whole = 0;
+        size_t digits = 0;
+        for (; pos < text.size() && isdigit(static_cast<unsigned char>(text[pos])); ++pos, ++digits) {
+            if (whole > (INT64_MAX / 100 - 9) / 10) return false;
+            whole = whole * 10 + (text[pos] - '0');
+        }
+        int64_t fraction = 0;
+        if (pos < text.size() && text[pos] == '.') {
+            pos++;
+            int scale = 0;
+            bool roundUp = false;
+            for (; pos < text.size() && isdigit(static_cast<unsigned char>(text[pos])); ++pos, ++digits) {
+                if (scale < 2) {
+                    fraction = fraction * 10 + (text[pos] - '0');
+                    scale++;
+                } else if (scale == 2) {
+                    roundUp = text[pos] >= '5';
+                    scale++;
+                }
+            }
+            for (; scale < 2; ++scale) fraction *= 10;
+            if (roundUp) fraction++;
+        }
+        if (digits == 0 || pos != text.size()) {
+            return false;
+        }
+        int64_t value = whole * 100 + fraction;
+        result = fromCents(negative ? -value : value);
+        return true;
+    }
+
+    int64_t getCents() const { return cents; }
+    double toDouble() const { return cents / 100.0; }
+
+    string toString() const {
+        uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+        string text = to_string(magnitude / 100);
+        text += '.';
+        text += static_cast<char>('0' + (magnitude % 100) / 10);
+        text += static_cast<char>('0' + magnitude % 10);
+        return cents < 0 ? "-" + text : text;
+    }
+
+    Money abs() const { return fromCents(cents < 0 ? -cents : cents); }
+
+    // One month of interest at an annual rate given in basis points
+    Money monthlyInterest(int64_t annualBasisPoints) const {
+        return fromCents(divideRounded(static_cast<__int128>(cents) * annualBasisPoints, 10000 * 12));
+    }
+
+    // Scales by a rational factor, rounding to the nearest cent
+    Money scaled(int64_t numerator, int64_t denominator) const {
+        return fromCents(divideRounded(static_cast<__int128>(cents) * numerator, denominator));
+    }
+
+    Money operator+(Money other) const { return fromCents(cents + other.cents); }
+    Money operator-(Money other) const { return fromCents(cents - other.cents); }
+    Money operator-() const { return fromCents(-cents); }
+    Money& operator+=(Money other) { cents += other.cents; return *this; }
+    Money& operator-=(Money other) { cents -= other.cents; return *this; }
+
+    bool operator==(Money other) const { return cents == other.cents; }
+    bool operator!=(Money other) const { return cents != other.cents; }
+    bool operator<(Money other) const { return cents < other.cents; }
+    bool operator<=(Money other) const { return cents <= other.cents; }
+    bool operator>(Money other) const { return cents > other.cents; }
+    bool operator>=(Money other) const { return cents >= other.cents; }
+
+    friend ostream& operator<<(ostream& out, Money money) {
+        return out << money.toString();
+    }
+};
+
+// Result of a non-throwing Bank operation: its status and, if it succeeded,
+// the balance it left in the account debited (or credited, for a deposit)
+struct OperationResult {
+    OperationStatus status;
+    Money balance;
+
+    bool ok() const { return status == OperationStatus::OK; }
+};
+
+// AccountHandle - dense integer reference to an account
+// The low bits are the account's slot in the bank (account number minus
+// firstNumber); the top two bits carry the AccountType, so the external
+// "SAV10001" form can be produced and checked without touching the account.
+struct AccountHandle {
+    static const uint32_t indexBits = 30;
+    static const uint32_t indexMask = (uint32_t(1) << indexBits) - 1;
+    static const uint32_t firstNumber = 10001;
+    static const uint32_t noneValue = UINT32_MAX;
+    static const uint32_t bankValue = UINT32_MAX - 1;
+    static const uint32_t externalValue = UINT32_MAX - 2;
+
+    uint32_t value;
+
+    static AccountHandle make(AccountType type, uint32_t index) {
+        return AccountHandle{ (static_cast<uint32_t>(type) << indexBits) | index };
+    }
+    static AccountHandle none() { return AccountHandle{ noneValue }; }
+    // Pseudo-accounts used as the other side of deposits, withdrawals and interest
+    static AccountHandle bank() { return AccountHandle{ bankValue }; }
+    static AccountHandle external() { return AccountHandle{ externalValue }; }
+
+    uint32_t index() const { return value & indexMask; }
+    AccountType type() const { return static_cast<AccountType>(value >> indexBits); }
+    bool isNone() const { return value == noneValue; }
+    bool isAccount() const { return value < externalValue; }
+
+    bool operator==(AccountHandle other) const { return value == other.value; }
+    bool operator!=(AccountHandle other) const { return value != other.value; }
+
+    static const char* prefix(AccountType type) {
+        switch(type) {
+            case AccountType::SAVINGS: return "SAV";
+            case AccountType::CHECKING: return "CHK";
+            case AccountType::LOAN: return "LOAN";
+            case AccountType::FIXED_DEPOSIT: return "FD";
+            default: return "";
+        }
+    }
+
+    string toString() const {
+        if (value == bankValue) return "BANK";
+        if (value == externalValue) return "EXTERNAL";
+        if (value == noneValue) return "";
+        return prefix(type()) + to_string(firstNumber + index());
+    }
+
+    // Parses the external "SAV10001" form; fails on unknown prefixes, a prefix
+    // that does not match the number's type, or numbers out of range
+    static bool parse(string_view text, AccountHandle& result) {
+        static const AccountType types[] = { AccountType::SAVINGS, AccountType::CHECKING,
+                                             AccountType::LOAN, AccountType::FIXED_DEPOSIT };
+        for (AccountType type : types) {
+            string_view accountPrefix = prefix(type);
+            if (text.size() <= accountPrefix.size() || text.compare(0, accountPrefix.size(), accountPrefix) != 0) {
+                continue;
+            }
+            string_view digits = text.substr(accountPrefix.size());
+            if (digits.size() > 10) return false;
+            uint64_t number = 0;
+            for (char c : digits) {
+                if (!isdigit(static_cast<unsigned char>(c))) return false;
+                number = number * 10 + (c - '0');
+            }
+            if (number < firstNumber || number - firstNumber > indexMask) {
+                return false;
+            }
+            result = make(type, static_cast<uint32_t>(number - firstNumber));
+            return result.isAccount();
+        }
+        return false;
+    }
+};
+
+// CustomerHandle - dense integer reference to a customer ("CUST1001" is index 0)
+struct CustomerHandle {
+    static const uint32_t firstNumber = 1001;
+
+    uint32_t value;
+
+    uint32_t index() const { return value; }
+    bool operator==(CustomerHandle other) const { return value == other.value; }
+
+    string toString() const { return "CUST" + to_string(firstNumber + value); }
+
+    static bool parse(string_view text, CustomerHandle& result) {
+        if (text.size() <= 4 || text.compare(0, 4, "CUST") != 0) {
+            return false;
+        }
+        uint64_t number = 0;
+        for (size_t i = 4; i < text.size(); ++i) {
+            if (!isdigit(static_cast<unsigned char>(text[i])) || number > UINT32_MAX) {
+                return false;
+            }
+            number = number * 10 + (text[i] - '0');
+        }
+        if (number < firstNumber || number - firstNumber >= UINT32_MAX) {
+            return false;
+        }
+        result = CustomerHandle{ static_cast<uint32_t>(number - firstNumber) };
+        return true;
+    }
+};
+
+// Enum for events emitted by accounts and the bank
+enum class BankEventType : uint8_t {
+    CUSTOMER_CREATED,
+    ACCOUNT_OPENED,
+    ACCOUNT_CLOSED,
+    DEPOSIT,
+    WITHDRAWAL,
+    WITHDRAWAL_REJECTED,
+    OVERDRAFT_FEE,
+    INTEREST_APPLIED,
+    TRANSFER,
+    INTEREST_RUN_STARTED,
+    INTEREST_ACCOUNT_STARTED,
+    INTEREST_ACCOUNT_FINISHED
+};
+
+// Structured event - account events carry handles; customer and bank events
+// carry a name that is a borrowed view, valid only for the duration of publish()
+struct BankEvent {
+    BankEventType type;
+    AccountHandle account;
+    AccountHandle counterparty;
+    string_view subject;
+    Money amount;
+    Money balance;
+};
+
+// Abstract sink receiving every published event
+class BankEventSink {
+public:
+    virtual ~BankEventSink() = default;
+    virtual void publish(const BankEvent& event) = 0;
+    virtual void flush() {}
+};
+
+// Sink that discards everything
+class NullEventSink : public BankEventSink {
+public:
+    void publish(const BankEvent&) override {}
+};
+
+// Sink that renders events as the human readable console messages
+class TextEventSink : public BankEventSink {
+protected:
+    static const char* accountTypeName(AccountType type) {
+        switch(type) {
+            case AccountType::SAVINGS: return "Savings";
+            case AccountType::CHECKING: return "Checking";
+            case AccountType::LOAN: return "Loan";
+            case AccountType::FIXED_DEPOSIT: return "Fixed Deposit";
+            default: return "Unknown";
+        }
+    }
+
+    static void render(ostream& out, const BankEvent& event) {
+        switch(event.type) {
+            case BankEventType::CUSTOMER_CREATED:
+                out << "Customer created successfully with ID: " << event.subject << '\n';
+                break;
+            case BankEventType::ACCOUNT_OPENED:
+                out << accountTypeName(event.account.type()) << " account created successfully with ID: "
+                    << event.account.toString() << '\n';
+                break;
+            case BankEventType::ACCOUNT_CLOSED:
+                out << "Account " << event.account.toString() << " has been closed." << '\n';
+                break;
+            case BankEventType::DEPOSIT:
+                if (event.account.type() == AccountType::LOAN) {
+                    out << "Payment of $" << event.amount << " applied to Loan Account. Remaining balance: $"
+                        << event.balance.abs() << '\n';
+                } else {
+                    out << "Deposited $" << event.amount << " to " << accountTypeName(event.account.type())
+                        << " Account. New balance: $" << event.balance << '\n';
+                }
+                break;
+            case BankEventType::WITHDRAWAL:
+                out << "Withdrew $" << event.amount << " from " << accountTypeName(event.account.type())
+                    << " Account. New balance: $" << event.balance << '\n';
+                break;
+            case BankEventType::WITHDRAWAL_REJECTED:
+                out << "Withdrawals not allowed on loan accounts." << '\n';
+                break;
+            case BankEventType::OVERDRAFT_FEE:
+                out << "Overdraft fee of $" << event.amount << " applied." << '\n';
+                break;
+            case BankEventType::INTEREST_APPLIED:
+                if (event.account.type() == AccountType::LOAN) {
+                    out << "Interest of $" << event.amount << " applied to Loan Account. Remaining balance: $"
+                        << event.balance.abs() << '\n';
+                } else {
+                    out << "Interest of $" << event.amount << " credited to " << accountTypeName(event.account.type())
+                        << " Account. New balance: $" << event.balance << '\n';
+                }
+                break;
+            case BankEventType::TRANSFER:
+                out << "Transfer of $" << event.amount << " completed from " << event.account.toString()
+                    << " to " << event.counterparty.toString() << '\n';
+                break;
+            case BankEventType::INTEREST_RUN_STARTED:
+                out << "\n=== Processing Monthly Interest ===" << '\n';
+                break;
+            case BankEventType::INTEREST_ACCOUNT_STARTED:
+                out << "Processing account: " << event.account.toString() << '\n';
+                break;
+            case BankEventType::INTEREST_ACCOUNT_FINISHED:
+                out << "------------------------" << '\n';
+                break;
+        }
+    }
+};
+
+// Sink that writes each event straight to a stream (the interactive default)
+class ConsoleEventSink : public TextEventSink {
+private:
+    ostream& out;
+    mutex outputMutex;
+
+public:
+    explicit ConsoleEventSink(ostream& output = cout) : out(output) {}
+
+    void publish(const BankEvent& event) override {
+        lock_guard<mutex> lock(outputMutex);
+        render(out, event);
+    }
+
+    void flush() override {
+        lock_guard<mutex> lock(outputMutex);
+        out.flush();
+    }
+};
+
+// Sink that formats into an in-memory buffer and writes it out in large chunks
+class BufferedTextEventSink : public TextEventSink {
+private:
+    ostream& out;
+    ostringstream buffer;
+    size_t capacity;
+    mutex bufferMutex;
+
+    void flushLocked() {
+        out << buffer.str();
+        out.flush();
+        buffer.str("");
+    }
+
+public:
+    BufferedTextEventSink(ostream& output, size_t bufferBytes = 1 << 16)
+        : out(output), capacity(bufferBytes) {}
+
+    ~BufferedTextEventSink() override { flush(); }
+
+    void publish(const BankEvent& event) override {
+        lock_guard<mutex> lock(bufferMutex);
+        render(buffer, event);
+        if (static_cast<size_t>(buffer.tellp()) >= capacity) {
+            flushLocked();
+        }
+    }
+
+    void flush() override {
+        lock_guard<mutex> lock(bufferMutex);
+        flushLocked();
+    }
+};
+
+// Sink that appends compact binary records to a file:
+// [u8 type][u32 account][u32 counterparty][i64 amount cents][i64 balance cents][u16 len][subject]
+class BinaryLogEventSink : public BankEventSink {
+private:
+    ofstream file;
+    vector<char> buffer;
+    mutex fileMutex;
+
+public:
+    explicit BinaryLogEventSink(const string& filename) : buffer(1 << 16) {
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(filename, ios::binary | ios::app);
+        if (!file.is_open()) {
+            throw runtime_error("cannot open event log " + filename);
+        }
+    }
+
+    void publish(const BankEvent& event) override {
+        lock_guard<mutex> lock(fileMutex);
+        uint8_t type = static_cast<uint8_t>(event.type);
+        uint32_t handles[2] = { event.account.value, event.counterparty.value };
+        int64_t amounts[2] = { event.amount.getCents(), event.balance.getCents() };
+        uint16_t length = static_cast<uint16_t>(min<size_t>(event.subject.size(), UINT16_MAX));
+        file.write(reinterpret_cast<const char*>(&type), sizeof(type));
+        file.write(reinterpret_cast<const char*>(handles), sizeof(handles));
+        file.write(reinterpret_cast<const char*>(amounts), sizeof(amounts));
+        file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        file.write(event.subject.data(), length);
+    }
+
+    void flush() override {
+        lock_guard<mutex> lock(fileMutex);
+        file.flush();
+    }
+};
+
+// Process-wide event dispatch; a null sink means quiet mode and costs one branch per op
+class BankEvents {
+private:
+    static BankEventSink* sink;
+
+public:
+    static bool enabled() { return sink != nullptr; }
+    static void setSink(BankEventSink* newSink) {
+        if (sink) sink->flush();
+        sink = newSink;
+    }
+    static BankEventSink* getSink() { return sink; }
+    static void flush() {
+        if (sink) sink->flush();
+    }
+
+    static void publish(BankEventType type, AccountHandle account, Money amount = Money(),
+                        Money balance = Money(), AccountHandle counterparty = AccountHandle::none()) {
+        if (sink) {
+            sink->publish(BankEvent{type, account, counterparty, {}, amount, balance});
+        }
+    }
+
+    static void publishNamed(BankEventType type, string_view subject) {
+        if (sink) {
+            sink->publish(BankEvent{type, AccountHandle::none(), AccountHandle::none(), subject, Money(), Money()});
+        }
+    }
+};
+
+ConsoleEventSink defaultConsoleSink;
+BankEventSink* BankEvents::sink = &defaultConsoleSink;
+
+// Time helpers - records keep seconds since the epoch and only format on display
+inline int64_t currentEpochSeconds() {
+    return chrono::duration_cast<chrono::seconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline string formatEpochSeconds(int64_t epochSeconds, const char* format) {
+    time_t time = static_cast<time_t>(epochSeconds);
+    tm local;
+    localtime_r(&time, &local);
+    char text[64];
+    size_t length = strftime(text, sizeof(text), format, &local);
+    return string(text, length);
+}
+
+// TransactionIdAllocator class - process-wide unique 64-bit transaction IDs
+// Threads reserve blocks of IDs from a shared atomic counter and then hand
+// them out locally, so the shared counter is touched once per block rather
+// than once per transaction. IDs are unique and roughly increasing (blocks
+// from different threads interleave). reseed() moves the counter past IDs
+// that already exist, e.g. after loading saved data, and retires any blocks
+// threads are still holding.
+class TransactionIdAllocator {
+private:
+    static const uint64_t blockSize = 1024;
+
+    struct LocalBlock {
+        uint64_t next = 0;
+        uint64_t end = 0;
+        uint64_t epoch = 0;
+    };
+
+    static atomic<uint64_t> nextBlockStart;
+    static atomic<uint64_t> epoch;
+    static thread_local LocalBlock local;
+
+public:
+    static uint64_t next() {
+        uint64_t currentEpoch = epoch.load(memory_order_acquire);
+        if (local.next == local.end || local.epoch != currentEpoch) {
+            local.next = nextBlockStart.fetch_add(blockSize, memory_order_relaxed);
+            local.end = local.next + blockSize;
+            local.epoch = currentEpoch;
+        }
+        return local.next++;
+    }
+
+    // Guarantees every ID allocated afterwards is greater than lastUsedId
+    static void reseed(uint64_t lastUsedId) {
+        uint64_t current = nextBlockStart.load(memory_order_relaxed);
+        while (current <= lastUsedId &&
+               !nextBlockStart.compare_exchange_weak(current, lastUsedId + 1, memory_order_relaxed)) {}
+        epoch.fetch_add(1, memory_order_release);
+    }
+
+    // Upper bound on every ID handed out so far (including unused block tails)
+    static uint64_t highWaterMark() { return nextBlockStart.load(memory_order_relaxed) - 1; }
+};
+
+// Initialize static members
+atomic<uint64_t> TransactionIdAllocator::nextBlockStart{1};
+atomic<uint64_t> TransactionIdAllocator::epoch{1};
+thread_local TransactionIdAllocator::LocalBlock TransactionIdAllocator::local;
+
+// Bank operations with latency and outcome metrics
+enum class BankOperation : uint8_t {
+    FIND_ACCOUNT,
+    DEPOSIT,
+    WITHDRAW,
+    TRANSFER,
+    TRANSFER_BATCH,
+    REQUEST_BATCH,
+    LEDGER_APPEND,
+    MONTHLY_INTEREST
+};
+
+const size_t bankOperationCount = 8;
+
+// How a measured operation ended: success, or the status it returned or the
+// BankException subtype it threw
+enum class OperationOutcome : uint8_t {
+    SUCCEEDED,
+    INSUFFICIENT_FUNDS,
+    ACCOUNT_NOT_FOUND,
+    INVALID_AMOUNT,
+    REFUSED,
+    BATCH_REJECTED,
+    OTHER_ERROR
+};
+
+const size_t operationOutcomeCount = 7;
+static_assert(static_cast<size_t>(OperationOutcome::REFUSED) == static_cast<size_t>(OperationStatus::REFUSED),
+              "the first outcomes mirror OperationStatus");
+
+// BankMetrics class - process-wide operation metrics: outcome counters and
+// HDR-style latency histograms (log-linear buckets with 16 steps per power of
+// two, so a bucket is within about 6% of its values). Each thread records into
+// its own block with plain relaxed stores, so recording takes no locks and
+// shares no cache lines; reads merge every thread's block. Blocks outlive
+// their threads so nothing recorded is lost. Compiling with -DBANK_NO_METRICS
+// removes the instrumentation entirely.
+class BankMetrics {
+public:
+    struct Summary {
+        uint64_t outcomes[operationOutcomeCount] = {};
+        uint64_t count = 0;
+        uint64_t totalNanos = 0;
+        uint64_t maxNanos = 0;
+        uint64_t p50 = 0, p90 = 0, p99 = 0, p999 = 0;
+    };
+
+    static const char* operationName(BankOperation operation) {
+        static const char* const names[] = { "find_account", "deposit", "withdraw", "transfer",
+                                             "transfer_batch", "request_batch", "ledger_append",
+                                             "monthly_interest" };
+        return names[static_cast<size_t>(operation)];
+    }
+
+    static const char* outcomeName(OperationOutcome outcome) {
+        static const char* const names[] = { "succeeded", "insufficient_funds", "account_not_found",
+                                             "invalid_amount", "refused", "batch_rejected", "other_error" };
+        return names[static_cast<size_t>(outcome)];
+    }
+
+#ifndef BANK_NO_METRICS
+private:
+    static const size_t subBucketBits = 4;
+    static const size_t subBuckets = size_t(1) << subBucketBits;
+    static const size_t bucketCount = (64 - subBucketBits + 1) * subBuckets;
+
+    struct alignas(64) ThreadBlock {
+        atomic<uint64_t> outcomes[bankOperationCount][operationOutcomeCount] = {};
+        atomic<uint64_t> buckets[bankOperationCount][bucketCount] = {};
+        atomic<uint64_t> totalNanos[bankOperationCount] = {};
+        atomic<uint64_t> maxNanos[bankOperationCount] = {};
+    };
+
+    static mutex registryMutex;
+    static vector<unique_ptr<ThreadBlock>> blocks;
+
+    static ThreadBlock& local() {
+        thread_local ThreadBlock* block = [] {
+            lock_guard<mutex> lock(registryMutex);
+            blocks.push_back(make_unique<ThreadBlock>());
+            return blocks.back().get();
+        }();
+        return *block;
+    }
+
+    // Single writer per block: a relaxed load and store is enough
+    static void bump(atomic<uint64_t>& counter, uint64_t by = 1) {
+        counter.store(counter.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    static size_t bucketOf(uint64_t nanos) {
+        if (nanos < subBuckets) {
+            return static_cast<size_t>(nanos);
+        }
+        size_t exponent = 63 - __builtin_clzll(nanos);
+        size_t step = (nanos >> (exponent - subBucketBits)) & (subBuckets - 1);
+        return (exponent - subBucketBits + 1) * subBuckets + step;
+    }
+
+    // Largest value that falls in a bucket
+    static uint64_t bucketLimit(size_t bucket) {
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        size_t exponent = bucket / subBuckets + subBucketBits - 1;
+        uint64_t low = (uint64_t(1) << exponent) | (uint64_t(bucket % subBuckets) << (exponent - subBucketBits));
+        return low + (uint64_t(1) << (exponent - subBucketBits)) - 1;
+    }
+
+    // Operations returning an OperationResult report failures by status
+    template <typename Result>
+    static OperationOutcome outcomeOf(const Result&) {
+        return OperationOutcome::SUCCEEDED;
+    }
+
+    static OperationOutcome outcomeOf(const OperationResult& result) {
+        return static_cast<OperationOutcome>(result.status);
+    }
+
+    static uint64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void record(BankOperation operation, OperationOutcome outcome, uint64_t start) {
+        uint64_t nanos = now() - start;
+        ThreadBlock& block = local();
+        size_t op = static_cast<size_t>(operation);
+        bump(block.outcomes[op][static_cast<size_t>(outcome)]);
+        bump(block.buckets[op][bucketOf(nanos)]);
+        bump(block.totalNanos[op], nanos);
+        if (nanos > block.maxNanos[op].load(memory_order_relaxed)) {
+            block.maxNanos[op].store(nanos, memory_order_relaxed);
+        }
+    }
+
+public:
+    static constexpr bool enabled = true;
+
+    // Runs an operation, recording its latency and how it ended; exceptions
+    // are counted by type and rethrown
+    template <typename Operation>
+    static decltype(auto) measure(BankOperation operation, Operation&& body) {
+        uint64_t start = now();
+        try {
+            if constexpr (is_void_v<decltype(body())>) {
+                body();
+                record(operation, OperationOutcome::SUCCEEDED, start);
+            } else {
+                decltype(auto) result = body();
+                record(operation, outcomeOf(result), start);
+                return result;
+            }
+        }
+        catch (const InsufficientFundsException&) {
+            record(operation, OperationOutcome::INSUFFICIENT_FUNDS, start);
+            throw;
+        }
+        catch (const AccountNotFoundException&) {
+            record(operation, OperationOutcome::ACCOUNT_NOT_FOUND, start);
+            throw;
+        }
+        catch (const InvalidAmountException&) {
+            record(operation, OperationOutcome::INVALID_AMOUNT, start);
+            throw;
+        }
+        catch (const BatchTransferException&) {
+            record(operation, OperationOutcome::BATCH_REJECTED, start);
+            throw;
+        }
+        catch (...) {
+            record(operation, OperationOutcome::OTHER_ERROR, start);
+            throw;
+        }
+    }
+
+    // Merges every thread's counts for one operation
+    static Summary summary(BankOperation operation) {
+        size_t op = static_cast<size_t>(operation);
+        Summary result;
+        vector<uint64_t> merged(bucketCount);
+        {
+            lock_guard<mutex> lock(registryMutex);
+            for (const auto& block : blocks) {
+                for (size_t outcome = 0; outcome < operationOutcomeCount; ++outcome) {
+                    result.outcomes[outcome] += block->outcomes[op][outcome].load(memory_order_relaxed);
+                }
+                for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+                    merged[bucket] += block->buckets[op][bucket].load(memory_order_relaxed);
+                }
+                result.totalNanos += block->totalNanos[op].load(memory_order_relaxed);
+                result.maxNanos = max(result.maxNanos, block->maxNanos[op].load(memory_order_relaxed));
+            }
+        }
+        for (uint64_t count : merged) {
+            result.count += count;
+        }
+        auto percentile = [&](double p) -> uint64_t {
+            uint64_t rank = static_cast<uint64_t>(ceil(p * result.count));
+            uint64_t seen = 0;
+            for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+                seen += merged[bucket];
+                if (seen >= max<uint64_t>(rank, 1)) {
+                    return min(bucketLimit(bucket), result.maxNanos);
+                }
+            }
+            return 0;
+        };
+        if (result.count != 0) {
+            result.p50 = percentile(0.50);
+            result.p90 = percentile(0.90);
+            result.p99 = percentile(0.99);
+            result.p999 = percentile(0.999);
+        }
+        return result;
+    }
+#else
+public:
+    static constexpr bool enabled = false;
+
+    template <typename Operation>
+    static decltype(auto) measure(BankOperation, Operation&& body) {
+        return body();
+    }
+
+    static Summary summary(BankOperation) { return Summary(); }
+#endif
+
+    // Text table, or one JSON object keyed by operation name
+    static void dump(ostream& out, bool json) {
+        if (!enabled) {
+            out << (json ? "{\"enabled\":false}" : "Metrics are compiled out (BANK_NO_METRICS)") << endl;
+            return;
+        }
+        if (json) {
+            out << "{";
+        } else {
+            out << "=== Bank Metrics (latency in ns) ===" << endl;
+        }
+        for (size_t op = 0; op < bankOperationCount; ++op) {
+            BankOperation operation = static_cast<BankOperation>(op);
+            Summary metrics = summary(operation);
+            uint64_t mean = metrics.count != 0 ? metrics.totalNanos / metrics.count : 0;
+            if (json) {
+                out << (op ? "," : "") << "\"" << operationName(operation) << "\":{\"count\":" << metrics.count;
+                for (size_t outcome = 0; outcome < operationOutcomeCount; ++outcome) {
+                    out << ",\"" << outcomeName(static_cast<OperationOutcome>(outcome)) << "\":"
+                        << metrics.outcomes[outcome];
+                }
+                out << ",\"mean\":" << mean << ",\"p50\":" << metrics.p50 << ",\"p90\":" << metrics.p90
+                    << ",\"p99\":" << metrics.p99 << ",\"p999\":" << metrics.p999
+                    << ",\"max\":" << metrics.maxNanos << "}";
+            } else {
+                out << left << setw(17) << operationName(operation) << right << " count=" << metrics.count;
+                for (size_t outcome = 0; outcome < operationOutcomeCount; ++outcome) {
+                    if (metrics.outcomes[outcome] != 0 && outcome != static_cast<size_t>(OperationOutcome::SUCCEEDED)) {
+                        out << " " << outcomeName(static_cast<OperationOutcome>(outcome)) << "="
+                            << metrics.outcomes[outcome];
+                    }
+                }
+                out << " mean=" << mean << " p50=" << metrics.p50 << " p90=" << metrics.p90
+                    << " p99=" << metrics.p99 << " p999=" << metrics.p999 << " max=" << metrics.maxNanos << endl;
+            }
+        }
+        if (json) {
+            out << "}" << endl;
+        }
+    }
+};
+
+#ifndef BANK_NO_METRICS
+mutex BankMetrics::registryMutex;
+vector<unique_ptr<BankMetrics::ThreadBlock>> BankMetrics::blocks;
+#endif
+
+// On-disk form of a transaction, as stored in snapshots (native byte order)
+struct TransactionRecord {
+    uint64_t transactionId;
+    int64_t amountCents;
+    int64_t timestamp;
+    uint32_t from;
+    uint32_t to;
+    uint32_t descriptionRef;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(TransactionRecord) == 40, "snapshot transaction layout");
+
+// Transaction class - fixed-size ledger record; the description is a
+// reference into the owning TransactionLedger's string table
+class Transaction {
+private:
+    uint64_t transactionId;
+    AccountHandle from;
+    AccountHandle to;
+    uint32_t descriptionRef;
+    TransactionType type;
+    Money amount;
+    int64_t timestamp;
+
+public:
+    Transaction(AccountHandle fromAccount, AccountHandle toAccount, Money amt, TransactionType t, uint32_t desc,
+                int64_t time = currentEpochSeconds())
+        : transactionId(TransactionIdAllocator::next()), from(fromAccount), to(toAccount), descriptionRef(desc),
+          type(t), amount(amt), timestamp(time) {}
+
+    // Restores a saved record, keeping its original ID
+    explicit Transaction(const TransactionRecord& record)
+        : transactionId(record.transactionId), from(AccountHandle{ record.from }), to(AccountHandle{ record.to }),
+          descriptionRef(record.descriptionRef), type(static_cast<TransactionType>(record.type)),
+          amount(Money::fromCents(record.amountCents)), timestamp(record.timestamp) {}
+
+    TransactionRecord toRecord() const {
+        return TransactionRecord{ transactionId, amount.getCents(), timestamp, from.value, to.value,
+                                  descriptionRef, static_cast<uint8_t>(type), {} };
+    }
+
+    // Getters
+    uint64_t getTransactionId() const { return transactionId; }
+    AccountHandle getFrom() const { return from; }
+    AccountHandle getTo() const { return to; }
+    uint32_t getDescriptionRef() const { return descriptionRef; }
+    Money getAmount() const { return amount; }
+    TransactionType getType() const { return type; }
+    int64_t getTimestampEpoch() const { return timestamp; }
+    string getTimestamp() const { return formatEpochSeconds(timestamp, "%Y-%m-%d %H:%M:%S"); }
+
+    static const char* typeName(TransactionType type) {
+        switch(type) {
+            case TransactionType::DEPOSIT: return "DEPOSIT";
+            case TransactionType::WITHDRAWAL: return "WITHDRAWAL";
+            case TransactionType::TRANSFER: return "TRANSFER";
+            case TransactionType::LOAN_PAYMENT: return "LOAN_PAYMENT";
+            case TransactionType::INTEREST_CREDIT: return "INTEREST_CREDIT";
+            case TransactionType::INTEREST_CHARGE: return "INTEREST_CHARGE";
+            case TransactionType::FEE: return "FEE";
+            case TransactionType::LOAN_DISBURSEMENT: return "LOAN_DISBURSEMENT";
+            default: return "UNKNOWN";
+        }
+    }
+
+    string getTypeString() const { return typeName(type); }
+
+    void display(const TransactionLedger& ledger) const;
+};
+
+// TransactionLedger class - append-only arena of transaction records
+// Records live in fixed-capacity chunks that never move, so a record's index
+// stays valid forever and scans walk memory sequentially. Appends are
+// serialized by a mutex; readers never lock: the chunk directory is reserved
+// up front and the record count is published with release ordering, so any
+// index below size() can be read concurrently with further appends.
+//
+// An append throws once the ledger is full. Every balance change is therefore
+// appended before it is applied, so a failed append leaves the balances as
+// they were and the ledger still accounts for every one of them.
+class TransactionLedger {
+public:
+    using Index = uint64_t;
+
+private:
+    static constexpr size_t chunkBits = 14;
+    static constexpr size_t chunkCapacity = size_t(1) << chunkBits;
+    static constexpr size_t chunkMask = chunkCapacity - 1;
+    static constexpr size_t maxChunks = size_t(1) << 18;
+
+    vector<unique_ptr<vector<Transaction>>> chunks;
+    atomic<size_t> count;
+    array<atomic<uint64_t>, transactionTypeCount> typeCounts;
+    int64_t lastTimestamp;
+    mutable mutex appendMutex;
+
+    // Interned descriptions referenced by records
+    vector<string> strings;
+    unordered_map<string, uint32_t> stringRefs;
+
+    // Record times never decrease in ledger order, even if the clock steps
+    // back, so per-account histories can be searched by time. Caller holds appendMutex.
+    int64_t nextTimestamp() {
+        lastTimestamp = max(lastTimestamp, currentEpochSeconds());
+        return lastTimestamp;
+    }
+
+public:
+    TransactionLedger() : count(0), lastTimestamp(0) {
+        chunks.reserve(maxChunks);
+        for (auto& typeCount : typeCounts) {
+            typeCount.store(0, memory_order_relaxed);
+        }
+        intern("");
+    }
+
+    uint32_t intern(const string& text) {
+        lock_guard<mutex> lock(appendMutex);
+        auto it = stringRefs.find(text);
+        if (it != stringRefs.end()) {
+            return it->second;
+        }
+        uint32_t ref = static_cast<uint32_t>(strings.size());
+        strings.push_back(text);
+        stringRefs.emplace(text, ref);
+        return ref;
+    }
+
+    const string& resolve(uint32_t ref) const { return strings[ref]; }
+    size_t stringCount() const {
+        lock_guard<mutex> lock(appendMutex);
+        return strings.size();
+    }
+
+    // Descriptions are interned up front so appends never hash strings
+    Index append(AccountHandle from, AccountHandle to, Money amount,
+                 TransactionType type, uint32_t descriptionRef = 0) {
+        return BankMetrics::measure(BankOperation::LEDGER_APPEND, [&] {
+            lock_guard<mutex> lock(appendMutex);
+            size_t index = count.load(memory_order_relaxed);
+            if ((index & chunkMask) == 0) {
+                if (chunks.size() == maxChunks) {
+                    throw BankException("Transaction ledger is full");
+                }
+                chunks.push_back(make_unique<vector<Transaction>>());
+                chunks.back()->reserve(chunkCapacity);
+            }
+            chunks.back()->emplace_back(from, to, amount, type, descriptionRef, nextTimestamp());
+            typeCounts[static_cast<size_t>(type)].fetch_add(1, memory_order_relaxed);
+            count.store(index + 1, memory_order_release);
+            return index;
+        });
+    }
+
+    // A record to be appended in bulk
+    struct Entry {
+        AccountHandle from;
+        AccountHandle to;
+        Money amount;
+        TransactionType type;
+        uint32_t descriptionRef;
+    };
+
+    // Appends many records under one lock acquisition with one shared timestamp;
+    // the records get consecutive indices starting at the returned one
+    Index appendBulk(const vector<Entry>& entries) {
+        return BankMetrics::measure(BankOperation::LEDGER_APPEND, [&] {
+            lock_guard<mutex> lock(appendMutex);
+            size_t first = count.load(memory_order_relaxed);
+            if (first + entries.size() > maxChunks * chunkCapacity) {
+                throw BankException("Transaction ledger is full");
+            }
+            int64_t timestamp = nextTimestamp();
+            size_t index = first;
+            for (const Entry& entry : entries) {
+                if ((index & chunkMask) == 0) {
+                    chunks.push_back(make_unique<vector<Transaction>>());
+                    chunks.back()->reserve(chunkCapacity);
+                }
+                chunks.back()->emplace_back(entry.from, entry.to, entry.amount, entry.type,
+                                            entry.descriptionRef, timestamp);
+                typeCounts[static_cast<size_t>(entry.type)].fetch_add(1, memory_order_relaxed);
+                index++;
+            }
+            count.store(index, memory_order_release);
+            return first;
+        });
+    }
+
+    // Appends saved records as they are, keeping their IDs and timestamps;
+    // descriptionRefs maps each record's saved description reference to this
+    // ledger's reference for the same text
+    void restore(const char* records, size_t n, const vector<uint32_t>& descriptionRefs) {
+        lock_guard<mutex> lock(appendMutex);
+        size_t index = count.load(memory_order_relaxed);
+        if (index + n > maxChunks * chunkCapacity) {
+            throw BankException("Transaction ledger is full");
+        }
+        for (size_t i = 0; i < n; ++i, ++index) {
+            TransactionRecord record;
+            memcpy(&record, records + i * sizeof(record), sizeof(record));
+            if (record.descriptionRef >= descriptionRefs.size() || record.type >= transactionTypeCount) {
+                throw BankException("Snapshot contains a malformed transaction");
+            }
+            record.descriptionRef = descriptionRefs[record.descriptionRef];
+            if ((index & chunkMask) == 0) {
+                chunks.push_back(make_unique<vector<Transaction>>());
+                chunks.back()->reserve(chunkCapacity);
+            }
+            chunks.back()->emplace_back(record);
+            typeCounts[record.type].fetch_add(1, memory_order_relaxed);
+            lastTimestamp = max(lastTimestamp, record.timestamp);
+        }
+        count.store(index, memory_order_release);
+    }
+
+    const Transaction& at(Index index) const {
+        return chunks[index >> chunkBits]->data()[index & chunkMask];
+    }
+
+    size_t size() const { return count.load(memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+    // Bytes of the record chunks (each reserved in full) and their directory
+    size_t recordBytes() const {
+        lock_guard<mutex> lock(appendMutex);
+        return chunks.size() * (sizeof(vector<Transaction>) + chunkCapacity * sizeof(Transaction)) +
+               chunks.capacity() * sizeof(unique_ptr<vector<Transaction>>);
+    }
+
+    // Approximate bytes of the interned descriptions: each string is held by
+    // the list and as a map key, plus the map's node and bucket
+    size_t descriptionBytes() const {
+        lock_guard<mutex> lock(appendMutex);
+        size_t bytes = strings.capacity() * sizeof(string) + stringRefs.bucket_count() * sizeof(void*);
+        for (const string& text : strings) {
+            bytes += sizeof(pair<const string, uint32_t>) + sizeof(void*) + 2 * text.size();
+        }
+        return bytes;
+    }
+
+    // Records of one type appended so far, maintained on append
+    uint64_t countOf(TransactionType type) const {
+        return typeCounts[static_cast<size_t>(type)].load(memory_order_relaxed);
+    }
+
+    // Streams every record appended so far in append order, one chunk at a time
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        size_t total = size();
+        for (size_t chunk = 0; chunk * chunkCapacity < total; ++chunk) {
+            const Transaction* records = chunks[chunk]->data();
+            size_t inChunk = min(chunkCapacity, total - chunk * chunkCapacity);
+            for (size_t i = 0; i < inChunk; ++i) {
+                visit(records[i]);
+            }
+        }
+    }
+};
+
+void Transaction::display(const TransactionLedger& ledger) const {
+    cout << "ID: " << transactionId 
+         << " | Type: " << getTypeString()
+         << " | Amount: $" << amount
+         << " | Time: " << getTimestamp()
+         << " | From: " << from.toString()
+         << " | To: " << to.toString()
+         << " | Desc: " << ledger.resolve(descriptionRef) << endl;
+}
+
+// HistoryEntry - one transaction in an account's history index. It carries the
+// record's type and time so history queries can filter and seek without
+// reading ledger records.
+struct HistoryEntry {
+    static_assert(transactionTypeCount <= 8, "transaction type must fit in three bits");
+
+    uint64_t packed;   // ledger index << 3 | transaction type
+    int64_t timestamp;
+
+    static HistoryEntry of(TransactionLedger::Index index, const Transaction& transaction) {
+        return HistoryEntry{ index << 3 | static_cast<uint64_t>(transaction.getType()),
+                             transaction.getTimestampEpoch() };
+    }
+
+    TransactionLedger::Index index() const { return packed >> 3; }
+    TransactionType type() const { return static_cast<TransactionType>(packed & 7); }
+};
+
+// Filters for Bank::queryHistory and Bank::countHistory
+struct HistoryQuery {
+    static const uint32_t allTypes = (1u << transactionTypeCount) - 1;
+
+    int64_t from = INT64_MIN;    // earliest time, inclusive (epoch seconds)
+    int64_t until = INT64_MAX;   // latest time, exclusive
+    uint32_t typeMask = allTypes; // bit (1 << TransactionType) per wanted type
+    size_t limit = 50;
+    uint64_t cursor = 0;          // nextCursor of the previous page; 0 starts at the newest
+
+    bool wants(TransactionType type) const { return (typeMask >> static_cast<uint32_t>(type)) & 1; }
+};
+
+// One transfer of a batch passed to Bank::transferBatch
+struct TransferInstruction {
+    AccountHandle from;
+    AccountHandle to;
+    Money amount;
+};
+
+// One deposit, withdrawal, transfer or balance query, as executed in groups by
+// Bank::executeRequests and queued by BankPipeline
+struct BankRequest {
+    enum class Kind : uint8_t { DEPOSIT, WITHDRAW, TRANSFER, BALANCE };
+
+    Kind kind;
+    AccountHandle account; // the account credited, debited or queried
+    AccountHandle to;      // transfers only
+    Money amount;
+
+    static BankRequest deposit(AccountHandle accountId, Money amount) {
+        return BankRequest{ Kind::DEPOSIT, accountId, AccountHandle::external(), amount };
+    }
+    static BankRequest withdraw(AccountHandle accountId, Money amount) {
+        return BankRequest{ Kind::WITHDRAW, accountId, AccountHandle::external(), amount };
+    }
+    static BankRequest transfer(AccountHandle from, AccountHandle to, Money amount) {
+        return BankRequest{ Kind::TRANSFER, from, to, amount };
+    }
+    static BankRequest balance(AccountHandle accountId) {
+        return BankRequest{ Kind::BALANCE, accountId, AccountHandle::external(), Money() };
+    }
+};
+
+// One page of an account's history, newest first
+struct HistoryPage {
+    vector<Transaction> transactions;
+    uint64_t nextCursor = 0; // pass back to continue; 0 when nothing older matches the time range
+};
+
+// StableVector class - append-only array whose elements never move
+// Elements live in fixed-size chunks reached through a directory reserved up
+// front, so appends never relocate anything and an element published to other
+// threads can be read while further appends happen. Appends must be serialized
+// by the caller.
+template <typename T>
+class StableVector {
+public:
+    static constexpr size_t chunkBits = 14;
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+    static constexpr size_t chunkMask = chunkSize - 1;
+    static constexpr size_t maxChunks = (size_t(AccountHandle::indexMask) + 1) >> chunkBits;
+
+private:
+    vector<unique_ptr<T[]>> chunks;
+    size_t count;
+
+public:
+    StableVector() : count(0) {
+        chunks.reserve(maxChunks);
+    }
+
+    T& operator[](size_t index) { return chunks[index >> chunkBits][index & chunkMask]; }
+    const T& operator[](size_t index) const { return chunks[index >> chunkBits][index & chunkMask]; }
+
+    void push_back(T value) {
+        if ((count & chunkMask) == 0) {
+            if (chunks.size() == maxChunks) {
+                throw BankException("Account table is full");
+            }
+            chunks.push_back(make_unique<T[]>(chunkSize));
+        }
+        (*this)[count++] = move(value);
+    }
+
+    // Bytes of the allocated chunks and the reserved directory (a vector
+    // element's own heap storage is not included)
+    size_t allocatedBytes() const {
+        return chunks.size() * chunkSize * sizeof(T) + chunks.capacity() * sizeof(unique_ptr<T[]>);
+    }
+
+    // Contiguous storage for elements [chunk * chunkSize, (chunk + 1) * chunkSize)
+    T* chunk(size_t chunkIndex) { return chunks[chunkIndex].get(); }
+    const T* chunk(size_t chunkIndex) const { return chunks[chunkIndex].get(); }
+};
+
+// One month of interest on a balance in cents at an annual rate in basis points,
+// rounded half away from zero exactly like Money::monthlyInterest. Uses 64-bit
+// arithmetic whenever the product cannot overflow and Money's 128-bit path otherwise.
+inline int64_t monthlyInterestCents(int64_t cents, int64_t annualBps) {
+    const int64_t balanceLimit = INT64_MAX / 100000;
+    if (cents < balanceLimit && cents > -balanceLimit && annualBps >= 0 && annualBps <= 10000) {
+        int64_t product = cents * annualBps;
+        int64_t rounded = ((product < 0 ? -product : product) + 60000) / 120000;
+        return product < 0 ? -rounded : rounded;
+    }
+    return Money::fromCents(cents).monthlyInterest(annualBps).getCents();
+}
+
+// Amortization class - fixed-rate loan arithmetic. Installments (EMIs) use the
+// annuity formula; schedules are built month by month in cents, charging each
+// month's interest with the same rounding as the monthly interest run, and the
+// last installment clears whatever remains. The batch kernels work on
+// contiguous columns with one rate, so (1 + r)^t is looked up in a table
+// built once per run instead of calling pow() per loan.
+class Amortization {
+public:
+    struct Installment {
+        int64_t payment;   // cents
+        int64_t interest;
+        int64_t principal;
+        int64_t balance;   // principal outstanding after this installment
+    };
+
+    static double monthlyRate(int64_t annualBps) { return annualBps / 10000.0 / 12; }
+
+    // (1 + r)^t for t = 0..maxTerm
+    static vector<double> growthTable(int64_t annualBps, int maxTerm) {
+        vector<double> growth(max(maxTerm, 0) + 1);
+        for (size_t t = 0; t < growth.size(); ++t) {
+            growth[t] = pow(1 + monthlyRate(annualBps), static_cast<double>(t));
+        }
+        return growth;
+    }
+
+    static Money installment(Money amount, int term, int64_t annualBps) {
+        double rate = monthlyRate(annualBps);
+        double growth = pow(1 + rate, term);
+        return Money::fromDouble((amount.toDouble() * rate * growth) / (growth - 1));
+    }
+
+    // Installments for n loans at one rate; growth is growthTable() covering every term
+    static void installments(const int64_t* amounts, const int32_t* terms, size_t n, int64_t annualBps,
+                             const double* growth, int64_t* payments) {
+        double rate = monthlyRate(annualBps);
+        for (size_t i = 0; i < n; ++i) {
+            double g = growth[terms[i]];
+            payments[i] = llround((amounts[i] / 100.0 * rate * g) / (g - 1) * 100.0);
+        }
+    }
+
+    // Debt left after paying each loan's installment for the months that
+    // growth = (1 + r)^months covers, from the closed form of the annuity;
+    // loans that would be repaid in that time project to zero
+    static void project(const int64_t* debts, const int64_t* payments, size_t n, int64_t annualBps,
+                        double growth, int64_t* projected) {
+        double annuity = (growth - 1) / monthlyRate(annualBps);
+        for (size_t i = 0; i < n; ++i) {
+            double remaining = debts[i] / 100.0 * growth - payments[i] / 100.0 * annuity;
+            projected[i] = remaining > 0 ? llround(remaining * 100.0) : 0;
+        }
+    }
+
+    // Principal that installment number month repays on a scheduled balance
+    static int64_t scheduledPrincipal(int64_t balance, int month, int term, int64_t payment, int64_t annualBps) {
+        if (balance <= 0) {
+            return 0;
+        }
+        int64_t interest = monthlyInterestCents(balance, annualBps);
+        return month >= term ? balance : min(balance, max<int64_t>(0, payment - interest));
+    }
+
+    static vector<Installment> schedule(int64_t amount, int term, int64_t payment, int64_t annualBps) {
+        vector<Installment> installments;
+        installments.reserve(max(term, 0));
+        int64_t balance = amount;
+        for (int month = 1; month <= term && balance > 0; ++month) {
+            int64_t interest = monthlyInterestCents(balance, annualBps);
+            int64_t principal = scheduledPrincipal(balance, month, term, payment, annualBps);
+            balance -= principal;
+            installments.push_back(Installment{ principal + interest, interest, principal, balance });
+        }
+        return installments;
+    }
+};
+
+// How a payment into a loan was applied: accrued interest first, then the
+// principal needed to be back on schedule, and the rest as prepayment
+struct LoanPaymentSplit {
+    Money interest;
+    Money principal;
+    Money prepayment;
+};
+
+// Result of a loan portfolio projection
+struct LoanProjection {
+    size_t loans = 0;               // active loans with debt outstanding
+    Money outstanding;              // current debt
+    Money scheduledInstallments;    // one month of the loans' agreed installments
+    Money requiredInstallments;     // installments repaying each debt over its remaining term
+    Money projectedOutstanding;     // debt left after the projected months of scheduled installments
+};
+
+// AccountColumns - columns shared by every account table
+// Row r of each column describes one account; the account's number maps to its
+// row through the AccountStore directory. Operations common to all account
+// types live here and are bound statically. Every balance change goes through
+// setBalance() or adjustTotals() so the table's running totals stay exact.
+struct AccountColumns {
+    static constexpr size_t chunkSize = StableVector<int64_t>::chunkSize;
+
+    const AccountType type;
+    StableVector<int64_t> balance;       // cents
+    StableVector<uint8_t> active;
+    StableVector<uint32_t> owner;        // CustomerHandle value
+    StableVector<uint32_t> accountIndex; // AccountHandle index
+    StableVector<int64_t> creationTime;
+    StableVector<vector<HistoryEntry>> history; // in ledger order
+    uint32_t rows;
+
+    // Running totals, updated atomically so they can be read without locks;
+    // kept on their own cache line away from the read-mostly column headers
+    struct alignas(64) Totals {
+        atomic<int64_t> balance{0}; // sum of all balances, cents
+        atomic<int64_t> debit{0};   // sum of the magnitudes of negative balances, cents
+        atomic<uint32_t> active{0}; // rows not closed
+    } totals;
+
+    explicit AccountColumns(AccountType tableType) : type(tableType), rows(0) {}
+
+    AccountHandle handleAt(uint32_t row) const { return AccountHandle::make(type, accountIndex[row]); }
+    Money balanceAt(uint32_t row) const { return Money::fromCents(balance[row]); }
+
+    static int64_t debitOf(int64_t cents) { return cents < 0 ? -cents : 0; }
+
+    void adjustTotals(int64_t balanceChange, int64_t debitChange) {
+        if (balanceChange != 0) totals.balance.fetch_add(balanceChange, memory_order_relaxed);
+        if (debitChange != 0) totals.debit.fetch_add(debitChange, memory_order_relaxed);
+    }
+
+    void setBalance(uint32_t row, int64_t cents) {
+        int64_t previous = balance[row];
+        balance[row] = cents;
+        adjustTotals(cents - previous, debitOf(cents) - debitOf(previous));
+    }
+
+    void deposit(uint32_t row, Money amount) {
+        if (amount <= Money()) {
+            throw InvalidAmountException();
+        }
+        setBalance(row, balance[row] + amount.getCents());
+        BankEvents::publish(BankEventType::DEPOSIT, handleAt(row), amount, balanceAt(row));
+    }
+
+    // Month-end hook for the interest run, given the signed interest of n rows
+    // of one chunk; loans use it to track interest owed
+    void recordAccrual(size_t, size_t, const int64_t*) {}
+
+    size_t columnBytes() const {
+        return balance.allocatedBytes() + active.allocatedBytes() + owner.allocatedBytes() +
+               accountIndex.allocatedBytes() + creationTime.allocatedBytes() + history.allocatedBytes();
+    }
+
+    // Bytes of the history entries; the caller keeps the histories from changing
+    size_t historyBytes() const {
+        size_t bytes = 0;
+        for (uint32_t row = 0; row < rows; ++row) {
+            bytes += history[row].capacity() * sizeof(HistoryEntry);
+        }
+        return bytes;
+    }
+
+    // Sum of the balance column, streamed one contiguous chunk at a time
+    Money totalBalance() const {
+        int64_t total = 0;
+        for (size_t chunk = 0; chunk * chunkSize < rows; ++chunk) {
+            const int64_t* cents = balance.chunk(chunk);
+            size_t inChunk = min(chunkSize, rows - chunk * chunkSize);
+            for (size_t i = 0; i < inChunk; ++i) {
+                total += cents[i];
+            }
+        }
+        return Money::fromCents(total);
+    }
+
+protected:
+    uint32_t appendRow(uint32_t index, CustomerHandle customer, Money openingBalance,
+                       int64_t created, bool isActive) {
+        balance.push_back(openingBalance.getCents());
+        active.push_back(isActive ? 1 : 0);
+        owner.push_back(customer.value);
+        accountIndex.push_back(index);
+        creationTime.push_back(created);
+        history.push_back({});
+        adjustTotals(openingBalance.getCents(), debitOf(openingBalance.getCents()));
+        if (isActive) totals.active.fetch_add(1, memory_order_relaxed);
+        return rows++;
+    }
+};
+
+// Savings account table; the rate and minimum balance are held once for all rows
+struct SavingsTable : AccountColumns {
+    int64_t interestRateBps; // annual rate in basis points
+    Money minimumBalance;
+
+    SavingsTable()
+        : AccountColumns(AccountType::SAVINGS), interestRateBps(350), minimumBalance(Money::fromCents(10000)) {}
+
+    uint32_t open(uint32_t index, CustomerHandle customer, Money initialBalance,
+                  int64_t created = currentEpochSeconds(), bool isActive = true) {
+        return appendRow(index, customer, initialBalance, created, isActive);
+    }
+
+    // Balance a withdrawal from a balance of cents leaves, or why it is not allowed
+    OperationStatus balanceAfterWithdrawal(int64_t cents, Money amount, int64_t& after) const {
+        if (amount <= Money()) {
+            return OperationStatus::INVALID_AMOUNT;
+        }
+        if (Money::fromCents(cents) - amount < minimumBalance) {
+            return OperationStatus::INSUFFICIENT_FUNDS;
+        }
+        after = cents - amount.getCents();
+        return OperationStatus::OK;
+    }
+
+    OperationStatus withdraw(uint32_t row, Money amount) {
+        int64_t after;
+        OperationStatus status = balanceAfterWithdrawal(balance[row], amount, after);
+        if (status != OperationStatus::OK) {
+            return status;
+        }
+        setBalance(row, after);
+        BankEvents::publish(BankEventType::WITHDRAWAL, handleAt(row), amount, balanceAt(row));
+        return status;
+    }
+
+    // Signed change one month of interest makes to a balance
+    int64_t monthlyInterest(int64_t cents) const {
+        return monthlyInterestCents(cents, interestRateBps);
+    }
+};
+
+// Checking account table
+struct CheckingTable : AccountColumns {
+    Money overdraftLimit;
+    Money overdraftFee;
+    int64_t interestRateBps; // 0.1% annual rate on positive balances
+
+    CheckingTable()
+        : AccountColumns(AccountType::CHECKING), overdraftLimit(Money::fromCents(50000)),
+          overdraftFee(Money::fromCents(3500)), interestRateBps(10) {}
+
+    uint32_t open(uint32_t index, CustomerHandle customer, Money initialBalance,
+                  int64_t created = currentEpochSeconds(), bool isActive = true) {
+        return appendRow(index, customer, initialBalance, created, isActive);
+    }
+
+    // Balance a withdrawal from a balance of cents leaves, including the
+    // overdraft fee if it overdraws the account, or why it is not allowed
+    OperationStatus balanceAfterWithdrawal(int64_t cents, Money amount, int64_t& after) const {
+        if (amount <= Money()) {
+            return OperationStatus::INVALID_AMOUNT;
+        }
+        Money updated = Money::fromCents(cents) - amount;
+        if (updated < -overdraftLimit) {
+            return OperationStatus::INSUFFICIENT_FUNDS;
+        }
+        if (updated < Money()) {
+            updated -= overdraftFee;
+        }
+        after = updated.getCents();
+        return OperationStatus::OK;
+    }
+
+    OperationStatus withdraw(uint32_t row, Money amount) {
+        int64_t after;
+        OperationStatus status = balanceAfterWithdrawal(balance[row], amount, after);
+        if (status != OperationStatus::OK) {
+            return status;
+        }
+        bool overdrawn = after != balance[row] - amount.getCents();
+        setBalance(row, after);
+        if (overdrawn) {
+            BankEvents::publish(BankEventType::OVERDRAFT_FEE, handleAt(row), overdraftFee, balanceAt(row));
+        }
+
+        BankEvents::publish(BankEventType::WITHDRAWAL, handleAt(row), amount, balanceAt(row));
+        return status;
+    }
+
+    // Checking accounts only earn interest on positive balances
+    int64_t monthlyInterest(int64_t cents) const {
+        return cents > 0 ? monthlyInterestCents(cents, interestRateBps) : 0;
+    }
+};
+
+// Loan account table; balances are negative while debt is outstanding
+struct LoanTable : AccountColumns {
+    using Schedule = shared_ptr<const vector<Amortization::Installment>>;
+
+    int64_t interestRateBps; // annual rate in basis points
+    StableVector<int64_t> loanAmount;     // cents
+    StableVector<int32_t> termMonths;
+    StableVector<int64_t> monthlyPayment; // cents
+    // Repayment state, derived from the ledger (see Bank::rebuildLoanState)
+    StableVector<int64_t> interestDue;    // cents of charged interest not yet paid
+    StableVector<int32_t> monthsCharged;  // interest periods charged so far
+    StableVector<int64_t> scheduledDebt;  // cents of principal the schedule leaves after monthsCharged
+
+    static const int maxTermMonths = 600;
+
+private:
+    // Schedules for display, shared by loans with the same amount, term and
+    // installment; the cache is emptied when it fills up
+    struct ScheduleKey {
+        int64_t amount;
+        int64_t payment;
+        int32_t term;
+        bool operator==(const ScheduleKey& other) const {
+            return amount == other.amount && payment == other.payment && term == other.term;
+        }
+    };
+    struct ScheduleKeyHash {
+        size_t operator()(const ScheduleKey& key) const {
+            return hash<int64_t>()(key.amount * 1000003 ^ key.payment * 31 ^ key.term);
+        }
+    };
+    static const size_t scheduleCacheLimit = 1024;
+
+    mutable mutex scheduleMutex;
+    mutable unordered_map<ScheduleKey, Schedule, ScheduleKeyHash> schedules;
+
+public:
+    LoanTable() : AccountColumns(AccountType::LOAN), interestRateBps(650) {}
+
+    static void checkTerm(int term) {
+        if (term <= 0 || term > maxTermMonths) {
+            throw BankException("Loan term must be between 1 and " + to_string(maxTermMonths) + " months");
+        }
+    }
+
+    uint32_t open(uint32_t index, CustomerHandle customer, Money amount, int term) {
+        checkTerm(term);
+        Money payment = Amortization::installment(amount, term, interestRateBps);
+        return restore(index, customer, -amount, amount, term, payment, currentEpochSeconds(), true);
+    }
+
+    // Adds a row with every field given, e.g. from a snapshot
+    uint32_t restore(uint32_t index, CustomerHandle customer, Money currentBalance, Money amount, int term,
+                     Money payment, int64_t created, bool isActive) {
+        checkTerm(term);
+        loanAmount.push_back(amount.getCents());
+        termMonths.push_back(term);
+        monthlyPayment.push_back(payment.getCents());
+        interestDue.push_back(0);
+        monthsCharged.push_back(0);
+        scheduledDebt.push_back(amount.getCents());
+        return appendRow(index, customer, currentBalance, created, isActive);
+    }
+
+    size_t columnBytes() const {
+        return AccountColumns::columnBytes() + loanAmount.allocatedBytes() + termMonths.allocatedBytes() +
+               monthlyPayment.allocatedBytes() + interestDue.allocatedBytes() + monthsCharged.allocatedBytes() +
+               scheduledDebt.allocatedBytes();
+    }
+
+    // The loan's amortization schedule as agreed at opening
+    Schedule scheduleFor(uint32_t row) const {
+        ScheduleKey key{ loanAmount[row], monthlyPayment[row], termMonths[row] };
+        lock_guard<mutex> lock(scheduleMutex);
+        auto found = schedules.find(key);
+        if (found != schedules.end()) {
+            return found->second;
+        }
+        if (schedules.size() >= scheduleCacheLimit) {
+            schedules.clear();
+        }
+        Schedule schedule = make_shared<const vector<Amortization::Installment>>(
+            Amortization::schedule(key.amount, key.term, key.payment, interestRateBps));
+        schedules.emplace(key, schedule);
+        return schedule;
+    }
+
+    // Starts a loan's repayment state over, before replaying its history
+    void resetRepayment(uint32_t row) {
+        interestDue[row] = 0;
+        monthsCharged[row] = 0;
+        scheduledDebt[row] = loanAmount[row];
+    }
+
+    // Moves the scheduled principal on by the installment of the month just charged
+    void advanceSchedule(int64_t& scheduled, int32_t month, uint32_t row) const {
+        scheduled -= Amortization::scheduledPrincipal(scheduled, month, termMonths[row], monthlyPayment[row],
+                                                      interestRateBps);
+    }
+
+    // Charges cents (positive) of month-end interest to a loan
+    void accrue(uint32_t row, int64_t cents) {
+        interestDue[row] += cents;
+        advanceSchedule(scheduledDebt[row], ++monthsCharged[row], row);
+    }
+
+    void recordAccrual(size_t chunk, size_t n, const int64_t* interest) {
+        int64_t* due = interestDue.chunk(chunk);
+        int32_t* charged = monthsCharged.chunk(chunk);
+        int64_t* scheduled = scheduledDebt.chunk(chunk);
+        uint32_t first = static_cast<uint32_t>(chunk * chunkSize);
+        for (size_t i = 0; i < n; ++i) {
+            if (interest[i] != 0) {
+                due[i] -= interest[i];
+                advanceSchedule(scheduled[i], ++charged[i], first + static_cast<uint32_t>(i));
+            }
+        }
+    }
+
+    // Splits a payment made while the loan's balance was balanceBefore and
+    // settles the interest it covers; the caller applies the balance change
+    LoanPaymentSplit splitPayment(uint32_t row, int64_t balanceBefore, Money amount) {
+        int64_t debt = max<int64_t>(0, -balanceBefore);
+        int64_t due = min(interestDue[row], debt);
+        int64_t paid = amount.getCents();
+        int64_t interest = min(paid, due);
+        int64_t behind = max<int64_t>(0, debt - due - scheduledDebt[row]);
+        int64_t principal = min(paid - interest, behind);
+        interestDue[row] = due - interest;
+        return LoanPaymentSplit{ Money::fromCents(interest), Money::fromCents(principal),
+                                 Money::fromCents(paid - interest - principal) };
+    }
+
+    // A payment reduces the debt
+    LoanPaymentSplit deposit(uint32_t row, Money amount) {
+        if (amount <= Money()) {
+            throw InvalidAmountException();
+        }
+        LoanPaymentSplit split = splitPayment(row, balance[row], amount);
+        AccountColumns::deposit(row, amount);
+        return split;
+    }
+
+    // Portfolio run over every active loan, one contiguous chunk at a time:
+    // the installment that would repay each debt over its remaining term, and
+    // the debt left after months more of the agreed installments
+    LoanProjection project(int months) const {
+        vector<double> growth = Amortization::growthTable(interestRateBps, maxTermMonths);
+        double projectedGrowth = pow(1 + Amortization::monthlyRate(interestRateBps), max(months, 0));
+
+        LoanProjection result;
+        int64_t outstanding = 0, scheduled = 0, required = 0, projected = 0;
+        vector<int64_t> debts(chunkSize), payments(chunkSize), requiredOut(chunkSize), projectedOut(chunkSize);
+        vector<int32_t> remaining(chunkSize);
+        for (size_t chunk = 0; chunk * chunkSize < rows; ++chunk) {
+            size_t n = min(chunkSize, rows - chunk * chunkSize);
+            const int64_t* balances = balance.chunk(chunk);
+            const uint8_t* isActive = active.chunk(chunk);
+            const int32_t* terms = termMonths.chunk(chunk);
+            const int32_t* charged = monthsCharged.chunk(chunk);
+            const int64_t* agreed = monthlyPayment.chunk(chunk);
+            for (size_t i = 0; i < n; ++i) {
+                bool owing = isActive[i] && balances[i] < 0;
+                debts[i] = owing ? -balances[i] : 0;
+                payments[i] = owing ? agreed[i] : 0;
+                remaining[i] = max(1, terms[i] - charged[i]);
+                result.loans += owing ? 1 : 0;
+            }
+            Amortization::installments(debts.data(), remaining.data(), n, interestRateBps, growth.data(),
+                                       requiredOut.data());
+            Amortization::project(debts.data(), payments.data(), n, interestRateBps, projectedGrowth,
+                                  projectedOut.data());
+            for (size_t i = 0; i < n; ++i) {
+                outstanding += debts[i];
+                scheduled += payments[i];
+                required += requiredOut[i];
+                projected += projectedOut[i];
+            }
+        }
+        result.outstanding = Money::fromCents(outstanding);
+        result.scheduledInstallments = Money::fromCents(scheduled);
+        result.requiredInstallments = Money::fromCents(required);
+        result.projectedOutstanding = Money::fromCents(projected);
+        return result;
+    }
+
+    // Loans do not allow withdrawals
+    OperationStatus balanceAfterWithdrawal(int64_t, Money, int64_t&) const {
+        return OperationStatus::REFUSED;
+    }
+
+    OperationStatus withdraw(uint32_t row, Money amount) {
+        BankEvents::publish(BankEventType::WITHDRAWAL_REJECTED, handleAt(row), amount, balanceAt(row));
+        return OperationStatus::REFUSED;
+    }
+
+    // Interest on the outstanding amount increases the debt
+    int64_t monthlyInterest(int64_t cents) const {
+        return -monthlyInterestCents(cents < 0 ? -cents : cents, interestRateBps);
+    }
+};
+
+// Abstract base class for all accounts
+// An Account is a read-only view of one row in its type's table. It holds no
+// account state itself, so views are created on demand and several may refer
+// to the same account; balances change only through Bank, which records each
+// change in the ledger.
+class Account {
+protected:
+    const AccountColumns& columns;
+    AccountHandle handle;
+    uint32_t row;
+
+public:
+    Account(const AccountColumns& table, AccountHandle accountHandle, uint32_t tableRow)
+        : columns(table), handle(accountHandle), row(tableRow) {}
+
+    virtual ~Account() = default;
+
+    // Pure virtual functions
+    virtual string getAccountTypeString() const = 0;
+    virtual void displayAccountInfo() const = 0;
+
+    // Getters
+    AccountHandle getHandle() const { return handle; }
+    CustomerHandle getOwner() const { return CustomerHandle{ columns.owner[row] }; }
+    string getAccountId() const { return handle.toString(); }
+    string getCustomerId() const { return getOwner().toString(); }
+    Money getBalance() const { return columns.balanceAt(row); }
+    AccountType getAccountType() const { return handle.type(); }
+    int64_t getCreationTime() const { return columns.creationTime[row]; }
+    string getCreationDate() const { return formatEpochSeconds(getCreationTime(), "%Y-%m-%d"); }
+    bool getIsActive() const { return columns.active[row] != 0; }
+
+    // Common methods
+    const vector<HistoryEntry>& getTransactionHistory() const { return columns.history[row]; }
+
+    void displayTransactionHistory(const TransactionLedger& ledger) const {
+        cout << "\n=== Transaction History for Account: " << getAccountId() << " ===" << endl;
+        if (getTransactionHistory().empty()) {
+            cout << "No transactions found." << endl;
+            return;
+        }
+        
+        for (const HistoryEntry& entry : getTransactionHistory()) {
+            ledger.at(entry.index()).display(ledger);
+        }
+    }
+};
+
+// Savings Account class
+class SavingsAccount : public Account {
+private:
+    const SavingsTable& table;
+
+public:
+    SavingsAccount(const SavingsTable& savings, AccountHandle accountHandle, uint32_t tableRow)
+        : Account(savings, accountHandle, tableRow), table(savings) {}
+
+    int64_t getInterestRateBps() const { return table.interestRateBps; }
+
+    string getAccountTypeString() const override {
+        return "SAVINGS";
+    }
+
+    void displayAccountInfo() const override {
+        cout << "\n=== Savings Account Information ===" << endl;
+        cout << "Account ID: " << getAccountId() << endl;
+        cout << "Customer ID: " << getCustomerId() << endl;
+        cout << "Balance: $" << getBalance() << endl;
+        cout << "Interest Rate: " << fixed << setprecision(1) << table.interestRateBps / 100.0 << "%" << endl;
+        cout << "Minimum Balance: $" << table.minimumBalance << endl;
+        cout << "Creation Date: " << getCreationDate() << endl;
+        cout << "Status: " << (getIsActive() ? "Active" : "Closed") << endl;
+    }
+};
+
+// Checking Account class
+class CheckingAccount : public Account {
+private:
+    const CheckingTable& table;
+
+public:
+    CheckingAccount(const CheckingTable& checking, AccountHandle accountHandle, uint32_t tableRow)
+        : Account(checking, accountHandle, tableRow), table(checking) {}
+
+    string getAccountTypeString() const override {
+        return "CHECKING";
+    }
+
+    int64_t getInterestRateBps() const { return table.interestRateBps; }
+
+    void displayAccountInfo() const override {
+        cout << "\n=== Checking Account Information ===" << endl;
+        cout << "Account ID: " << getAccountId() << endl;
+        cout << "Customer ID: " << getCustomerId() << endl;
+        cout << "Balance: $" << getBalance() << endl;
+        cout << "Overdraft Limit: $" << table.overdraftLimit << endl;
+        cout << "Overdraft Fee: $" << table.overdraftFee << endl;
+        cout << "Creation Date: " << getCreationDate() << endl;
+        cout << "Status: " << (getIsActive() ? "Active" : "Closed") << endl;
+    }
+};
+
+// Loan Account class
+class LoanAccount : public Account {
+private:
+    const LoanTable& table;
+
+public:
+    LoanAccount(const LoanTable& loans, AccountHandle accountHandle, uint32_t tableRow)
+        : Account(loans, accountHandle, tableRow), table(loans) {}
+
+    string getAccountTypeString() const override {
+        return "LOAN";
+    }
+
+    Money getLoanAmount() const { return Money::fromCents(table.loanAmount[row]); }
+    int getTermMonths() const { return table.termMonths[row]; }
+    Money getMonthlyPayment() const { return Money::fromCents(table.monthlyPayment[row]); }
+    int64_t getInterestRateBps() const { return table.interestRateBps; }
+    Money getInterestDue() const { return Money::fromCents(table.interestDue[row]); }
+    int getMonthsCharged() const { return table.monthsCharged[row]; }
+    Money getScheduledBalance() const { return Money::fromCents(table.scheduledDebt[row]); }
+    LoanTable::Schedule getSchedule() const { return table.scheduleFor(row); }
+
+    void displayAccountInfo() const override {
+        cout << "\n=== Loan Account Information ===" << endl;
+        cout << "Account ID: " << getAccountId() << endl;
+        cout << "Customer ID: " << getCustomerId() << endl;
+        cout << "Original Loan Amount: $" << getLoanAmount() << endl;
+        cout << "Remaining Balance: $" << getBalance().abs() << endl;
+        cout << "Interest Rate: " << fixed << setprecision(1) << table.interestRateBps / 100.0 << "%" << endl;
+        cout << "Term: " << getTermMonths() << " months" << endl;
+        cout << "Monthly Payment: $" << getMonthlyPayment() << endl;
+        cout << "Interest Due: $" << getInterestDue() << endl;
+        cout << "Months Charged: " << getMonthsCharged() << endl;
+        cout << "Scheduled Principal: $" << getScheduledBalance() << endl;
+        cout << "Creation Date: " << getCreationDate() << endl;
+        cout << "Status: " << (getIsActive() ? "Active" : "Closed") << endl;
+    }
+};
+
+// On-disk form of an account, as stored in snapshots (native byte order);
+// the loan fields are zero for other account types
+struct AccountRecord {
+    uint32_t handle;
+    uint32_t owner;
+    int64_t balanceCents;
+    int64_t creationTime;
+    int64_t loanAmountCents;
+    int64_t monthlyPaymentCents;
+    int32_t termMonths;
+    uint8_t active;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(AccountRecord) == 48, "snapshot account layout");
+
+// AccountStore class - type-partitioned account storage
+// Savings, checking and loan accounts live in separate column tables, and a
+// directory maps every account number to its row. Additions must be
+// serialized by the caller and only become visible to resolve() once
+// published; resolve() itself never locks.
+class AccountStore {
+public:
+    SavingsTable savings;
+    CheckingTable checking;
+    LoanTable loans;
+
+private:
+    StableVector<uint32_t> rowOf;  // account index -> row in its type's table
+    StableVector<uint8_t> typeOf;  // account index -> AccountType
+    uint32_t added;
+    atomic<uint32_t> published;
+
+    uint32_t nextIndex() const {
+        if (added > AccountHandle::indexMask) {
+            throw BankException("Account capacity exhausted");
+        }
+        return added;
+    }
+
+    AccountHandle addToDirectory(AccountType type, uint32_t index, uint32_t row) {
+        rowOf.push_back(row);
+        typeOf.push_back(static_cast<uint8_t>(type));
+        added++;
+        return AccountHandle::make(type, index);
+    }
+
+public:
+    AccountStore() : added(0), published(0) {}
+
+    AccountHandle addSavings(CustomerHandle customer, Money initialBalance) {
+        uint32_t index = nextIndex();
+        return addToDirectory(AccountType::SAVINGS, index, savings.open(index, customer, initialBalance));
+    }
+
+    AccountHandle addChecking(CustomerHandle customer, Money initialBalance) {
+        uint32_t index = nextIndex();
+        return addToDirectory(AccountType::CHECKING, index, checking.open(index, customer, initialBalance));
+    }
+
+    AccountHandle addLoan(CustomerHandle customer, Money loanAmount, int termMonths) {
+        uint32_t index = nextIndex();
+        return addToDirectory(AccountType::LOAN, index, loans.open(index, customer, loanAmount, termMonths));
+    }
+
+    // Makes every account added so far visible to resolve()
+    void publish() { published.store(added, memory_order_release); }
+
+    size_t columnBytes() const { return savings.columnBytes() + checking.columnBytes() + loans.columnBytes(); }
+    size_t directoryBytes() const { return rowOf.allocatedBytes() + typeOf.allocatedBytes(); }
+    size_t historyBytes() const { return savings.historyBytes() + checking.historyBytes() + loans.historyBytes(); }
+
+    uint32_t size() const { return published.load(memory_order_acquire); }
+
+    // Finds a published account's row, rejecting handles whose type bits disagree
+    bool resolve(AccountHandle accountId, uint32_t& row) const {
+        if (!accountId.isAccount() || accountId.index() >= size() ||
+            typeOf[accountId.index()] != static_cast<uint8_t>(accountId.type())) {
+            return false;
+        }
+        row = rowOf[accountId.index()];
+        return true;
+    }
+
+    AccountHandle handleAt(uint32_t index) const {
+        return AccountHandle::make(static_cast<AccountType>(typeOf[index]), index);
+    }
+    uint32_t rowAt(uint32_t index) const { return rowOf[index]; }
+
+    AccountColumns& columnsFor(AccountType type) {
+        switch (type) {
+            case AccountType::SAVINGS: return savings;
+            case AccountType::CHECKING: return checking;
+            case AccountType::LOAN: return loans;
+            default: throw AccountNotFoundException();
+        }
+    }
+
+    const AccountColumns& columnsFor(AccountType type) const {
+        return const_cast<AccountStore*>(this)->columnsFor(type);
+    }
+
+    // Saved state of the account at an index
+    AccountRecord recordAt(uint32_t index) const {
+        AccountHandle accountId = handleAt(index);
+        uint32_t row = rowOf[index];
+        const AccountColumns& columns = columnsFor(accountId.type());
+        AccountRecord record{};
+        record.handle = accountId.value;
+        record.owner = columns.owner[row];
+        record.balanceCents = columns.balance[row];
+        record.creationTime = columns.creationTime[row];
+        record.active = columns.active[row];
+        if (accountId.type() == AccountType::LOAN) {
+            record.loanAmountCents = loans.loanAmount[row];
+            record.monthlyPaymentCents = loans.monthlyPayment[row];
+            record.termMonths = loans.termMonths[row];
+        }
+        return record;
+    }
+
+    // Re-adds a saved account; records must come in index order, and the
+    // restored accounts become visible at the next publish()
+    AccountHandle restore(const AccountRecord& record) {
+        AccountHandle accountId{ record.handle };
+        if (!accountId.isAccount() || accountId.index() != nextIndex()) {
+            throw BankException("Snapshot accounts are out of order");
+        }
+        uint32_t index = accountId.index();
+        CustomerHandle owner{ record.owner };
+        Money balance = Money::fromCents(record.balanceCents);
+        bool isActive = record.active != 0;
+        switch (accountId.type()) {
+            case AccountType::SAVINGS:
+                return addToDirectory(AccountType::SAVINGS, index,
+                                      savings.open(index, owner, balance, record.creationTime, isActive));
+            case AccountType::CHECKING:
+                return addToDirectory(AccountType::CHECKING, index,
+                                      checking.open(index, owner, balance, record.creationTime, isActive));
+            case AccountType::LOAN:
+                return addToDirectory(AccountType::LOAN, index,
+                                      loans.restore(index, owner, balance, Money::fromCents(record.loanAmountCents),
+                                                    record.termMonths, Money::fromCents(record.monthlyPaymentCents),
+                                                    record.creationTime, isActive));
+            default:
+                throw BankException("Snapshot contains an unsupported account type");
+        }
+    }
+
+    // Calls visitor(table, row) with the concrete table type, so per-type
+    // operations bind statically
+    template <typename Visitor>
+    auto visit(AccountHandle accountId, uint32_t row, Visitor visitor) -> decltype(visitor(savings, row)) {
+        switch (accountId.type()) {
+            case AccountType::SAVINGS: return visitor(savings, row);
+            case AccountType::CHECKING: return visitor(checking, row);
+            case AccountType::LOAN: return visitor(loans, row);
+            default: throw AccountNotFoundException();
+        }
+    }
+
+    // Creates an Account view of a published account, or null
+    shared_ptr<Account> view(AccountHandle accountId) const {
+        uint32_t row;
+        if (!resolve(accountId, row)) {
+            return nullptr;
+        }
+        switch (accountId.type()) {
+            case AccountType::SAVINGS: return make_shared<SavingsAccount>(savings, accountId, row);
+            case AccountType::CHECKING: return make_shared<CheckingAccount>(checking, accountId, row);
+            case AccountType::LOAN: return make_shared<LoanAccount>(loans, accountId, row);
+            default: return nullptr;
+        }
+    }
+};
+
+// StringArena class - append-only store for customer text
+// Strings are packed back to back as [u16 length][bytes] in 1MB chunks that
+// never move, so a string is a 4-byte reference and costs its length plus two
+// bytes, with no std::string header and no allocation of its own. intern()
+// keeps one copy of each distinct value (names repeat across customers);
+// store() always appends, and a replaced value's bytes are left behind.
+// Appends are serialized internally; reads never lock: the chunk directory is
+// reserved up front and a reference is only handed out once its bytes are written.
+class StringArena {
+public:
+    static const size_t maxLength = UINT16_MAX;
+
+private:
+    static const size_t chunkBits = 20;
+    static const size_t chunkSize = size_t(1) << chunkBits;
+    static const size_t chunkMask = chunkSize - 1;
+    static const size_t maxChunks = size_t(1) << (32 - chunkBits);
+    static const uint32_t noRef = UINT32_MAX; // never a string's reference: strings take at least two bytes
+
+    // Open-addressing table of interned strings (linear probing)
+    struct Slot {
+        uint32_t hash;
+        uint32_t ref;
+    };
+
+    vector<unique_ptr<char[]>> chunks;
+    size_t used = chunkSize; // bytes taken in the last chunk
+    vector<Slot> internTable;
+    size_t interned = 0;
+    mutable mutex appendMutex;
+
+    static uint32_t hashOf(string_view text) {
+        return static_cast<uint32_t>(hash<string_view>()(text));
+    }
+
+    // Caller holds appendMutex
+    uint32_t append(string_view text) {
+        if (text.size() > maxLength) {
+            throw BankException("Customer details are too long");
+        }
+        size_t needed = sizeof(uint16_t) + text.size();
+        if (used + needed > chunkSize) {
+            if (chunks.size() == maxChunks) {
+                throw BankException("Customer text storage is full");
+            }
+            chunks.push_back(unique_ptr<char[]>(new char[chunkSize]));
+            used = 0;
+        }
+        char* start = chunks.back().get() + used;
+        uint16_t length = static_cast<uint16_t>(text.size());
+        memcpy(start, &length, sizeof(length));
+        memcpy(start + sizeof(length), text.data(), text.size());
+        uint32_t ref = static_cast<uint32_t>((chunks.size() - 1) << chunkBits | used);
+        used += needed;
+        return ref;
+    }
+
+    void place(Slot slot) {
+        size_t mask = internTable.size() - 1;
+        size_t i = slot.hash & mask;
+        while (internTable[i].ref != noRef) {
+            i = (i + 1) & mask;
+        }
+        internTable[i] = slot;
+    }
+
+public:
+    StringArena() { chunks.reserve(maxChunks); }
+
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    string_view get(uint32_t ref) const {
+        const char* start = chunks[ref >> chunkBits].get() + (ref & chunkMask);
+        uint16_t length;
+        memcpy(&length, start, sizeof(length));
+        return string_view(start + sizeof(length), length);
+    }
+
+    uint32_t store(string_view text) {
+        lock_guard<mutex> lock(appendMutex);
+        return append(text);
+    }
+
+    // Returns the reference of an equal string stored by an earlier intern(), or stores it
+    uint32_t intern(string_view text) {
+        lock_guard<mutex> lock(appendMutex);
+        uint32_t hash = hashOf(text);
+        if (!internTable.empty()) {
+            size_t mask = internTable.size() - 1;
+            for (size_t i = hash & mask; internTable[i].ref != noRef; i = (i + 1) & mask) {
+                if (internTable[i].hash == hash && get(internTable[i].ref) == text) {
+                    return internTable[i].ref;
+                }
+            }
+        }
+        if ((interned + 1) * 2 > internTable.size()) {
+            vector<Slot> previous(max<size_t>(64, internTable.size() * 2), Slot{ 0, noRef });
+            previous.swap(internTable);
+            for (const Slot& slot : previous) {
+                if (slot.ref != noRef) {
+                    place(slot);
+                }
+            }
+        }
+        uint32_t ref = append(text);
+        place(Slot{ hash, ref });
+        interned++;
+        return ref;
+    }
+
+    // Bytes of the chunks and their directory
+    size_t textBytes() const {
+        lock_guard<mutex> lock(appendMutex);
+        return chunks.size() * chunkSize + chunks.capacity() * sizeof(unique_ptr<char[]>);
+    }
+
+    size_t internBytes() const {
+        lock_guard<mutex> lock(appendMutex);
+        return internTable.capacity() * sizeof(Slot);
+    }
+};
+
+// Customer class
+// Names and contact details are references into the bank's StringArena
+// (names interned), so a customer is a few words plus its account list.
+class Customer {
+private:
+    CustomerHandle handle;
+    uint32_t firstName;
+    uint32_t lastName;
+    uint32_t email;
+    uint32_t phone;
+    uint32_t address;
+    vector<AccountHandle> accountIds;
+    StringArena* text;
+    CustomerIndex* index = nullptr; // set once the customer is added to a bank's lookup indexes
+
+public:
+    Customer(CustomerHandle customerHandle, StringArena& arena, string_view fname, string_view lname,
+             string_view emailAddress, string_view phoneNumber, string_view addr)
+        : handle(customerHandle), firstName(arena.intern(fname)), lastName(arena.intern(lname)),
+          email(arena.store(emailAddress)), phone(arena.store(phoneNumber)), address(arena.store(addr)),
+          text(&arena) {}
+
+    // Getters
+    CustomerHandle getHandle() const { return handle; }
+    string getCustomerId() const { return handle.toString(); }
+    string_view getFirstName() const { return text->get(firstName); }
+    string_view getLastName() const { return text->get(lastName); }
+    string getFullName() const { return string(getFirstName()) + " " + string(getLastName()); }
+    string_view getEmail() const { return text->get(email); }
+    string_view getPhone() const { return text->get(phone); }
+    string_view getAddress() const { return text->get(address); }
+    const vector<AccountHandle>& getAccountIds() const { return accountIds; }
+
+    // Methods
+    void addAccount(AccountHandle accountId) {
+        accountIds.push_back(accountId);
+    }
+
+    void removeAccount(AccountHandle accountId) {
+        accountIds.erase(remove(accountIds.begin(), accountIds.end(), accountId), accountIds.end());
+    }
+
+    void displayCustomerInfo() const {
+        cout << "\n=== Customer Information ===" << endl;
+        cout << "Customer ID: " << getCustomerId() << endl;
+        cout << "Name: " << getFullName() << endl;
+        cout << "Email: " << getEmail() << endl;
+        cout << "Phone: " << getPhone() << endl;
+        cout << "Address: " << getAddress() << endl;
+        cout << "Number of Accounts: " << accountIds.size() << endl;
+        
+        if (!accountIds.empty()) {
+            cout << "Account IDs: ";
+            for (size_t i = 0; i < accountIds.size(); ++i) {
+                cout << accountIds[i].toString();
+                if (i < accountIds.size() - 1) cout << ", ";
+            }
+            cout << endl;
+        }
+    }
+
+    void indexedBy(CustomerIndex* customerIndex) { index = customerIndex; }
+
+    // Setters for updating customer information; email and phone changes
+    // are passed through the bank's lookup indexes
+    void setEmail(const string& newEmail);
+    void setPhone(const string& newPhone);
+    void setAddress(const string& newAddress) { address = text->store(newAddress); }
+};
+
+// CustomerIndex class - secondary lookups over a bank's customers: exact email
+// and phone matches through hash tables, and last-name prefix search through
+// customers sorted by last name (case-insensitive). Entries hold
+// customer numbers, key hashes and the first bytes of the last name; full keys
+// are read back from the customers, so the indexes cost a few bytes per customer. Lookups expect the owner to
+// keep the customer list stable (the bank's directory lock).
+class CustomerIndex {
+public:
+    enum class Field { EMAIL, PHONE };
+
+private:
+    // Open-addressing table from key hash to customer number (linear probing,
+    // backward-shift deletion). Equal keys may map to several customers, so
+    // callers confirm each candidate against the customer's actual key.
+    class HandleTable {
+        struct Slot {
+            uint32_t hash;
+            uint32_t customer;
+        };
+        static const uint32_t empty = UINT32_MAX;
+
+        vector<Slot> slots;
+        size_t used = 0;
+
+        size_t mask() const { return slots.size() - 1; }
+
+    public:
+        void reserve(size_t entries) {
+            size_t capacity = 16;
+            while (capacity < entries * 2) {
+                capacity *= 2;
+            }
+            if (capacity > slots.size()) {
+                vector<Slot> previous(capacity, Slot{ 0, empty });
+                previous.swap(slots);
+                used = 0;
+                for (const Slot& slot : previous) {
+                    if (slot.customer != empty) {
+                        insert(slot.hash, slot.customer);
+                    }
+                }
+            }
+        }
+
+        void insert(uint32_t hash, uint32_t customer) {
+            if ((used + 1) * 2 > slots.size()) {
+                reserve(max<size_t>(8, used * 2));
+            }
+            size_t i = hash & mask();
+            while (slots[i].customer != empty) {
+                i = (i + 1) & mask();
+            }
+            slots[i] = Slot{ hash, customer };
+            used++;
+        }
+
+        void erase(uint32_t hash, uint32_t customer) {
+            if (slots.empty()) {
+                return;
+            }
+            size_t hole = hash & mask();
+            while (slots[hole].customer != customer || slots[hole].hash != hash) {
+                if (slots[hole].customer == empty) {
+                    return;
+                }
+                hole = (hole + 1) & mask();
+            }
+            // Pull later entries of the probe run back over the hole when the
+            // hole lies between their home slot and where they sit
+            for (size_t i = (hole + 1) & mask(); slots[i].customer != empty; i = (i + 1) & mask()) {
+                size_t home = slots[i].hash & mask();
+                if (((i - home) & mask()) >= ((i - hole) & mask())) {
+                    slots[hole] = slots[i];
+                    hole = i;
+                }
+            }
+            slots[hole].customer = empty;
+            used--;
+        }
+
+        size_t memoryBytes() const { return slots.capacity() * sizeof(Slot); }
+
+        template <typename Visitor>
+        void forEach(uint32_t hash, Visitor visit) const {
+            if (slots.empty()) {
+                return;
+            }
+            for (size_t i = hash & mask(); slots[i].customer != empty; i = (i + 1) & mask()) {
+                if (slots[i].hash == hash) {
+                    visit(slots[i].customer);
+                }
+            }
+        }
+    };
+
+    static const size_t headLength = 16;
+
+    // Folded first headLength bytes of a name, zero padded, as two big-endian
+    // words so they compare in name order
+    struct NameHead {
+        uint64_t high;
+        uint64_t low;
+
+        explicit NameHead(string_view name) : high(0), low(0) {
+            for (size_t i = 0; i < headLength; ++i) {
+                uint64_t byte = i < name.size() ? static_cast<uint8_t>(tolower(static_cast<unsigned char>(name[i]))) : 0;
+                (i < 8 ? high : low) = (i < 8 ? high : low) << 8 | byte;
+            }
+        }
+
+        // -1, 0 or 1; 0 means the names agree on their first headLength bytes
+        int compare(const NameHead& other) const {
+            if (high != other.high) {
+                return high < other.high ? -1 : 1;
+            }
+            return low == other.low ? 0 : (low < other.low ? -1 : 1);
+        }
+    };
+
+    // A customer in the name order. Most last names fit in the head, so
+    // comparisons only read the customer for long names.
+    struct NameEntry {
+        NameHead head;
+        uint32_t customer;
+        uint32_t length;
+    };
+
+    // A prefix being searched for
+    struct NameKey {
+        NameHead head;
+        string_view name;
+    };
+
+    struct NameOrder {
+        using is_transparent = void;
+        const CustomerIndex* index;
+
+        string_view nameOf(const NameEntry& entry) const { return index->lastNameOf(entry.customer); }
+
+        // Reads the entry's full name only when the heads tie and a name is longer than the head
+        template <typename Other>
+        int compare(const NameEntry& entry, const NameHead& head, size_t length, Other otherName) const {
+            int order = entry.head.compare(head);
+            if (order != 0) {
+                return order;
+            }
+            if (entry.length <= headLength && length <= headLength) {
+                return entry.length == length ? 0 : (entry.length < length ? -1 : 1);
+            }
+            return compareFolded(nameOf(entry), otherName());
+        }
+
+        bool operator()(const NameEntry& a, const NameEntry& b) const {
+            int order = compare(a, b.head, b.length, [&] { return nameOf(b); });
+            return order < 0 || (order == 0 && a.customer < b.customer);
+        }
+        bool operator()(const NameEntry& entry, const NameKey& key) const {
+            return compare(entry, key.head, key.name.size(), [&] { return key.name; }) < 0;
+        }
+        bool operator()(const NameKey& key, const NameEntry& entry) const {
+            return compare(entry, key.head, key.name.size(), [&] { return key.name; }) > 0;
+        }
+    };
+
+    const vector<shared_ptr<Customer>>& customers;
+    HandleTable byEmail;
+    HandleTable byPhone;
+    // Name order: the bulk of the customers in one sorted array, and the ones
+    // added since it was last rebuilt in a tree. The tree is merged into the
+    // array once it holds an eighth as many, so a search is two binary
+    // searches and an insert costs a constant number of moves on average.
+    vector<NameEntry> sortedNames;
+    set<NameEntry, NameOrder> recentNames;
+    mutable shared_mutex indexMutex;
+
+    static uint32_t hashOf(string_view key) {
+        return static_cast<uint32_t>(hash<string_view>()(key));
+    }
+
+    static int compareFolded(string_view a, string_view b) {
+        size_t n = min(a.size(), b.size());
+        for (size_t i = 0; i < n; ++i) {
+            int x = tolower(static_cast<unsigned char>(a[i]));
+            int y = tolower(static_cast<unsigned char>(b[i]));
+            if (x != y) {
+                return x < y ? -1 : 1;
+            }
+        }
+        return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+    }
+
+    string_view lastNameOf(uint32_t customer) const { return customers[customer]->getLastName(); }
+
+    string_view contactOf(Field field, uint32_t customer) const {
+        return field == Field::EMAIL ? customers[customer]->getEmail() : customers[customer]->getPhone();
+    }
+
+    HandleTable& tableFor(Field field) { return field == Field::EMAIL ? byEmail : byPhone; }
+    const HandleTable& tableFor(Field field) const { return field == Field::EMAIL ? byEmail : byPhone; }
+
+    // Appends to matches the first entries (at most limit) of a sorted range
+    // whose last name starts with the key
+    template <typename Iterator>
+    void collectPrefix(Iterator it, Iterator end, const NameKey& key, size_t limit, vector<NameEntry>& matches) const {
+        for (size_t taken = 0; it != end && taken < limit; ++it, ++taken) {
+            string_view name = lastNameOf(it->customer);
+            if (name.size() < key.name.size() || compareFolded(name.substr(0, key.name.size()), key.name) != 0) {
+                break;
+            }
+            matches.push_back(*it);
+        }
+    }
+
+public:
+    explicit CustomerIndex(const vector<shared_ptr<Customer>>& customerList)
+        : customers(customerList), recentNames(NameOrder{ this }) {}
+
+    // Indexes every customer in the list in one pass (bulk loads into an empty index)
+    void addAll() {
+        unique_lock<shared_mutex> lock(indexMutex);
+        byEmail.reserve(customers.size());
+        byPhone.reserve(customers.size());
+        sortedNames.reserve(customers.size());
+        for (const auto& customer : customers) {
+            uint32_t number = customer->getHandle().index();
+            string_view lastName = customer->getLastName();
+            byEmail.insert(hashOf(customer->getEmail()), number);
+            byPhone.insert(hashOf(customer->getPhone()), number);
+            sortedNames.push_back(NameEntry{ NameHead(lastName), number, static_cast<uint32_t>(lastName.size()) });
+            customer->indexedBy(this);
+        }
+        sort(sortedNames.begin(), sortedNames.end(), NameOrder{ this });
+    }
+
+    // Indexes a customer just appended to the list and routes its contact changes here
+    void add(Customer& customer) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        uint32_t number = customer.getHandle().index();
+        byEmail.insert(hashOf(customer.getEmail()), number);
+        byPhone.insert(hashOf(customer.getPhone()), number);
+
+        string_view lastName = customer.getLastName();
+        recentNames.insert(NameEntry{ NameHead(lastName), number, static_cast<uint32_t>(lastName.size()) });
+        if (recentNames.size() > max<size_t>(1024, sortedNames.size() / 8)) {
+            vector<NameEntry> merged;
+            merged.reserve(sortedNames.size() + recentNames.size());
+            merge(sortedNames.begin(), sortedNames.end(), recentNames.begin(), recentNames.end(),
+                  back_inserter(merged), NameOrder{ this });
+            sortedNames.swap(merged);
+            recentNames.clear();
+        }
+        customer.indexedBy(this);
+    }
+
+    // Points a customer's email or phone (ref is the customer's own field) at
+    // a new value and re-files it in one step, so lookups never see a stale entry
+    void updateContact(Field field, CustomerHandle customer, uint32_t& ref, uint32_t newRef) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        HandleTable& table = tableFor(field);
+        table.erase(hashOf(contactOf(field, customer.index())), customer.index());
+        ref = newRef;
+        table.insert(hashOf(contactOf(field, customer.index())), customer.index());
+    }
+
+    // Bytes held by the indexes; tree nodes are estimated as the entry plus
+    // three links and a color word
+    size_t memoryBytes() const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        return byEmail.memoryBytes() + byPhone.memoryBytes() + sortedNames.capacity() * sizeof(NameEntry) +
+               recentNames.size() * (sizeof(NameEntry) + 4 * sizeof(void*));
+    }
+
+    // Customer numbers whose email or phone is exactly key, in ascending order
+    vector<uint32_t> findContact(Field field, const string& key) const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        vector<uint32_t> matches;
+        tableFor(field).forEach(hashOf(key), [&](uint32_t customer) {
+            if (contactOf(field, customer) == key) {
+                matches.push_back(customer);
+            }
+        });
+        sort(matches.begin(), matches.end());
+        return matches;
+    }
+
+    // Up to limit customer numbers whose last name starts with prefix
+    // (ignoring case), ordered by last name
+    vector<uint32_t> findLastNamePrefix(string_view prefix, size_t limit) const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        NameKey key{ NameHead(prefix), prefix };
+        NameOrder order{ this };
+        vector<NameEntry> matches;
+        collectPrefix(lower_bound(sortedNames.begin(), sortedNames.end(), key, order), sortedNames.end(),
+                      key, limit, matches);
+        size_t fromArray = matches.size();
+        collectPrefix(recentNames.lower_bound(key), recentNames.end(), key, limit, matches);
+        inplace_merge(matches.begin(), matches.begin() + fromArray, matches.end(), order);
+        vector<uint32_t> numbers;
+        for (size_t i = 0; i < matches.size() && i < limit; ++i) {
+            numbers.push_back(matches[i].customer);
+        }
+        return numbers;
+    }
+};
+
+void Customer::setEmail(const string& newEmail) {
+    uint32_t ref = text->store(newEmail);
+    if (index) {
+        index->updateContact(CustomerIndex::Field::EMAIL, handle, email, ref);
+    } else {
+        email = ref;
+    }
+}
+
+void Customer::setPhone(const string& newPhone) {
+    uint32_t ref = text->store(newPhone);
+    if (index) {
+        index->updateContact(CustomerIndex::Field::PHONE, handle, phone, ref);
+    } else {
+        phone = ref;
+    }
+}
+
+// InterestEngine class - month-end interest for every active account
+// Works directly on the account tables: each table's balance column is split
+// into its contiguous chunks, the chunks are spread across worker threads, and
+// every chunk runs through its table's statically bound interest formula (no
+// virtual calls, no gathering of balances). The formulas use exact integer
+// arithmetic with the same rounding as Money::monthlyInterest. A month is
+// computed without changing any account and applied in a second pass over the
+// same chunks, once its ledger records have been appended.
+class InterestEngine {
+public:
+    struct Posting {
+        AccountHandle account;
+        uint32_t row;
+        Money interest; // signed change applied to the balance
+        Money balance;  // balance after the change
+    };
+
+    // One month of interest, computed but not yet applied
+    struct Month {
+        vector<int64_t> interest[3]; // signed cents by row: savings, checking, loans
+        vector<Posting> postings;
+    };
+
+private:
+    static constexpr size_t chunkSize = AccountColumns::chunkSize;
+
+    // Work items are single chunks of one table
+    struct Slice {
+        int table;
+        size_t chunk;
+        size_t n;
+    };
+
+    template <typename Table>
+    static void computeChunk(const Table& table, size_t chunk, size_t n, int64_t* interest) {
+        const int64_t* balances = table.balance.chunk(chunk);
+        const uint8_t* active = table.active.chunk(chunk);
+        for (size_t i = 0; i < n; ++i) {
+            interest[i] = active[i] ? table.monthlyInterest(balances[i]) : 0;
+        }
+    }
+
+    template <typename Table>
+    static void applyChunk(Table& table, size_t chunk, size_t n, const int64_t* interest) {
+        int64_t* balances = table.balance.chunk(chunk);
+        int64_t balanceChange = 0, debitChange = 0;
+        for (size_t i = 0; i < n; ++i) {
+            int64_t before = balances[i];
+            balances[i] = before + interest[i];
+            balanceChange += interest[i];
+            debitChange += AccountColumns::debitOf(balances[i]) - AccountColumns::debitOf(before);
+        }
+        table.adjustTotals(balanceChange, debitChange);
+        table.recordAccrual(chunk, n, interest);
+    }
+
+    // Calls work(table, chunk, n, first row's interest) for every chunk of the
+    // three tables, spread over the workers
+    template <typename Work>
+    static void forEachSlice(const AccountStore& store, vector<int64_t> (&interest)[3], size_t workerThreads,
+                             Work work) {
+        vector<Slice> slices;
+        for (int table = 0; table < 3; ++table) {
+            size_t rows = table == 0 ? store.savings.rows : table == 1 ? store.checking.rows : store.loans.rows;
+            for (size_t chunk = 0; chunk * chunkSize < rows; ++chunk) {
+                slices.push_back(Slice{ table, chunk, min(chunkSize, rows - chunk * chunkSize) });
+            }
+        }
+
+        auto processRange = [&](size_t first, size_t step) {
+            for (size_t i = first; i < slices.size(); i += step) {
+                const Slice& slice = slices[i];
+                work(slice.table, slice.chunk, slice.n, interest[slice.table].data() + slice.chunk * chunkSize);
+            }
+        };
+
+        size_t workers = min(max<size_t>(1, workerThreads), slices.size());
+        if (workers <= 1) {
+            processRange(0, 1);
+        } else {
+            vector<thread> pool;
+            for (size_t w = 1; w < workers; ++w) {
+                pool.emplace_back(processRange, w, workers);
+            }
+            processRange(0, workers);
+            for (auto& worker : pool) {
+                worker.join();
+            }
+        }
+    }
+
+    static void collect(const AccountColumns& table, const vector<int64_t>& interest, vector<Posting>& postings) {
+        for (uint32_t row = 0; row < table.rows; ++row) {
+            if (table.active[row]) {
+                postings.push_back(Posting{ table.handleAt(row), row, Money::fromCents(interest[row]),
+                                            Money::fromCents(table.balance[row] + interest[row]) });
+            }
+        }
+    }
+
+public:
+    // Computes one month of interest without changing any account; the caller
+    // must hold every account lock and keep accounts from being added until
+    // it has applied the month. Postings cover every active account, grouped
+    // by table (savings, checking, loans) in row order.
+    static Month compute(const AccountStore& store, size_t workerThreads) {
+        Month month;
+        month.interest[0].resize(store.savings.rows);
+        month.interest[1].resize(store.checking.rows);
+        month.interest[2].resize(store.loans.rows);
+        forEachSlice(store, month.interest, workerThreads, [&](int table, size_t chunk, size_t n, int64_t* out) {
+            switch (table) {
+                case 0: computeChunk(store.savings, chunk, n, out); break;
+                case 1: computeChunk(store.checking, chunk, n, out); break;
+                case 2: computeChunk(store.loans, chunk, n, out); break;
+            }
+        });
+
+        month.postings.reserve(store.size());
+        collect(store.savings, month.interest[0], month.postings);
+        collect(store.checking, month.interest[1], month.postings);
+        collect(store.loans, month.interest[2], month.postings);
+        return month;
+    }
+
+    // Applies a computed month to the balances, running totals and loan accruals
+    static void apply(AccountStore& store, Month& month, size_t workerThreads) {
+        forEachSlice(store, month.interest, workerThreads, [&](int table, size_t chunk, size_t n, int64_t* in) {
+            switch (table) {
+                case 0: applyChunk(store.savings, chunk, n, in); break;
+                case 1: applyChunk(store.checking, chunk, n, in); break;
+                case 2: applyChunk(store.loans, chunk, n, in); break;
+            }
+        });
+    }
+};
+
+// LedgerReplay class - derives every account balance from the ledger alone.
+// Each balance change is a ledger record (opening deposits and loan
+// disbursements, deposits, withdrawals, transfers, fees and interest), so a
+// balance is what the account's records paid in minus what they took out.
+// Accounts are split into one contiguous partition per worker and the ledger
+// is replayed in windows of records (a single worker just adds up the records
+// in one pass). Within a window, each worker first sorts
+// its share of the records into postings per partition (a transfer becomes a
+// debit for its source's partition and a credit for its destination's); then
+// each worker applies its own partition's postings in ledger order. An account
+// is only ever written by one thread, so nothing is locked, and the workers
+// only wait for each other between the two phases.
+class LedgerReplay {
+public:
+    struct Result {
+        uint64_t records = 0;
+        vector<int64_t> balances; // derived balance by account index
+    };
+
+private:
+    static const uint64_t windowRecords = uint64_t(1) << 16;
+
+    struct Posting {
+        uint32_t index;
+        int64_t cents;
+    };
+
+    // Calls post(account index, signed cents) for each account side of records
+    // [begin, end); returns the first record naming an unknown account, if any
+    template <typename Post>
+    static uint64_t postRecords(const TransactionLedger& ledger, const AccountStore& store,
+                                uint64_t begin, uint64_t end, Post post) {
+        uint64_t unknown = UINT64_MAX;
+        for (uint64_t record = begin; record < end; ++record) {
+            const Transaction& transaction = ledger.at(record);
+            int64_t cents = transaction.getAmount().getCents();
+            uint32_t row;
+            if (transaction.getFrom().isAccount()) {
+                if (store.resolve(transaction.getFrom(), row)) {
+                    post(transaction.getFrom().index(), -cents);
+                } else {
+                    unknown = min(unknown, record);
+                }
+            }
+            if (transaction.getTo().isAccount()) {
+                if (store.resolve(transaction.getTo(), row)) {
+                    post(transaction.getTo().index(), cents);
+                } else {
+                    unknown = min(unknown, record);
+                }
+            }
+        }
+        return unknown;
+    }
+
+    // Holds each of a fixed number of threads until all of them have arrived;
+    // reusable, so one pool of workers can step through the windows together
+    class Barrier {
+    private:
+        mutex guard;
+        condition_variable released;
+        size_t parties;
+        size_t waiting;
+        uint64_t phase;
+
+    public:
+        explicit Barrier(size_t count) : parties(count), waiting(0), phase(0) {}
+
+        void wait() {
+            unique_lock<mutex> lock(guard);
+            uint64_t arrivedIn = phase;
+            if (++waiting == parties) {
+                waiting = 0;
+                phase++;
+                released.notify_all();
+                return;
+            }
+            released.wait(lock, [&] { return phase != arrivedIn; });
+        }
+    };
+
+    template <typename Work>
+    static void parallel(size_t workers, Work work) {
+        vector<thread> pool;
+        for (size_t w = 1; w < workers; ++w) {
+            pool.emplace_back(work, w);
+        }
+        work(0);
+        for (auto& worker : pool) {
+            worker.join();
+        }
+    }
+
+public:
+    // The caller must keep accounts from being added and the ledger from growing
+    static Result run(const TransactionLedger& ledger, const AccountStore& store, size_t workerThreads) {
+        Result result;
+        size_t accounts = store.size();
+        result.records = ledger.size();
+        result.balances.assign(accounts, 0);
+        size_t workers = max<size_t>(1, min<size_t>(workerThreads, accounts));
+        size_t partitionSize = (accounts + workers - 1) / workers;
+
+        int64_t* balances = result.balances.data();
+        vector<uint64_t> unknown(workers, UINT64_MAX); // first record naming an unknown account, per slice
+        if (workers == 1) {
+            unknown[0] = postRecords(ledger, store, 0, result.records, [&](uint32_t index, int64_t cents) {
+                balances[index] += cents;
+            });
+        }
+
+        // One pool for the whole run steps through the windows in lockstep:
+        // each worker posts its slice of the window by partition, then applies
+        // every slice's postings to its own partition
+        vector<vector<Posting>> postings(workers * workers); // [slice * workers + partition]
+        if (workers > 1 && result.records > 0) {
+            Barrier barrier(workers);
+            parallel(workers, [&](size_t worker) {
+                vector<Posting>* byPartition = &postings[worker * workers];
+                for (uint64_t windowStart = 0; windowStart < result.records; windowStart += windowRecords) {
+                    uint64_t windowEnd = min(result.records, windowStart + windowRecords);
+                    uint64_t sliceLength = (windowEnd - windowStart + workers - 1) / workers;
+                    uint64_t begin = min(windowEnd, windowStart + worker * sliceLength);
+                    uint64_t end = min(windowEnd, begin + sliceLength);
+                    unknown[worker] = min(unknown[worker], postRecords(ledger, store, begin, end,
+                                                                       [&](uint32_t index, int64_t cents) {
+                        byPartition[index / partitionSize].push_back(Posting{ index, cents });
+                    }));
+                    barrier.wait();
+
+                    for (size_t slice = 0; slice < workers; ++slice) {
+                        vector<Posting>& slicePostings = postings[slice * workers + worker];
+                        for (const Posting& posting : slicePostings) {
+                            balances[posting.index] += posting.cents;
+                        }
+                        slicePostings.clear();
+                    }
+                    barrier.wait();
+                }
+            });
+        }
+
+        uint64_t firstUnknown = *min_element(unknown.begin(), unknown.end());
+        if (firstUnknown != UINT64_MAX) {
+            throw BankException("Transaction " + to_string(ledger.at(firstUnknown).getTransactionId()) +
+                                " refers to an unknown account");
+        }
+        return result;
+    }
+};
+
+// An account whose stored balance differs from the one its ledger records give
+struct LedgerMismatch {
+    AccountHandle account;
+    Money stored;
+    Money derived;
+};
+
+// Outcome of replaying the ledger against the accounts
+struct LedgerAudit {
+    uint64_t records = 0;
+    size_t accounts = 0;
+    vector<LedgerMismatch> mismatches;
+
+    bool consistent() const { return mismatches.empty(); }
+};
+
+// Snapshot file layout (native byte order):
+//   SnapshotHeader
+//   bank name                 [u32 length][bytes]
+//   description strings       stringCount x [u32 length][bytes], in reference order
+//   customers                 customerCount x 5 x [u32 length][bytes]
+//                             (first name, last name, email, phone, address)
+//   padding to 8 bytes
+//   accounts                  accountCount x AccountRecord, in account number order
+//   transactions              transactionCount x TransactionRecord, in ledger order
+// Account histories are not stored; they are rebuilt from the ledger on load.
+// Version 2 ledgers record every balance change (fees, interest charges, loan
+// disbursements), so balances can be derived from them.
+struct SnapshotHeader {
+    static constexpr char magicText[] = "BANKSNAP";
+    static const uint32_t currentVersion = 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t customerCount;
+    uint64_t accountCount;
+    uint64_t transactionCount;
+    uint64_t stringCount;
+    uint64_t lastTransactionId;
+};
+
+// MappedFile class - read-only memory mapping of a whole file
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+
+public:
+    explicit MappedFile(const string& filename) : bytes(nullptr), length(0) {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw BankException("Cannot open " + filename);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            throw BankException("Cannot read " + filename);
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw BankException("Cannot map " + filename);
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+        bytes = static_cast<const char*>(mapping);
+    }
+
+    ~MappedFile() {
+        munmap(const_cast<char*>(bytes), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// SnapshotReader class - bounds-checked cursor over a mapped snapshot
+class SnapshotReader {
+private:
+    const char* bytes;
+    size_t length;
+    size_t pos;
+
+    const char* take(size_t size) {
+        if (size > length - pos) {
+            throw BankException("Snapshot file is truncated");
+        }
+        const char* start = bytes + pos;
+        pos += size;
+        return start;
+    }
+
+public:
+    SnapshotReader(const char* data, size_t size) : bytes(data), length(size), pos(0) {}
+
+    template <typename T>
+    T read() {
+        T value;
+        memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    string_view readString() {
+        uint32_t size = read<uint32_t>();
+        return string_view(take(size), size);
+    }
+
+    // Returns count fixed-size records in place
+    const char* readArray(uint64_t count, size_t recordSize) {
+        if (count > (length - pos) / recordSize) {
+            throw BankException("Snapshot file is truncated");
+        }
+        return take(count * recordSize);
+    }
+
+    void alignTo(size_t alignment) { take((alignment - pos % alignment) % alignment); }
+    size_t remaining() const { return length - pos; }
+};
+
+// SnapshotWriter class - buffered binary output that is synced to disk on commit
+class SnapshotWriter {
+private:
+    int fd;
+    string filename;
+    vector<char> buffer;
+    size_t used;
+    uint64_t written;
+
+    void flushBuffer() {
+        size_t done = 0;
+        while (done < used) {
+            ssize_t n = ::write(fd, buffer.data() + done, used - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw BankException("Cannot write " + filename);
+            }
+            done += static_cast<size_t>(n);
+        }
+        used = 0;
+    }
+
+public:
+    explicit SnapshotWriter(const string& path)
+        : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)), filename(path),
+          buffer(1 << 20), used(0), written(0) {
+        if (fd < 0) {
+            throw BankException("Cannot open " + filename + " for writing");
+        }
+    }
+
+    ~SnapshotWriter() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void write(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            if (used == buffer.size()) flushBuffer();
+            size_t chunk = min(size, buffer.size() - used);
+            memcpy(buffer.data() + used, bytes, chunk);
+            used += chunk;
+            bytes += chunk;
+            size -= chunk;
+            written += chunk;
+        }
+    }
+
+    template <typename T>
+    void writeValue(const T& value) { write(&value, sizeof(T)); }
+
+    void writeString(string_view text) {
+        writeValue(static_cast<uint32_t>(text.size()));
+        write(text.data(), text.size());
+    }
+
+    void alignTo(size_t alignment) {
+        static const char zeros[16] = {};
+        write(zeros, (alignment - written % alignment) % alignment);
+    }
+
+    uint64_t offset() const { return written; }
+
+    // Overwrites bytes already written, e.g. a header completed at the end
+    void patch(uint64_t position, const void* data, size_t size) {
+        flushBuffer();
+        if (pwrite(fd, data, size, static_cast<off_t>(position)) != static_cast<ssize_t>(size)) {
+            throw BankException("Cannot write " + filename);
+        }
+    }
+
+    // Flushes, syncs and closes the file
+    void commit() {
+        flushBuffer();
+        if (fsync(fd) != 0 || ::close(fd) != 0) {
+            fd = -1;
+            throw BankException("Cannot sync " + filename);
+        }
+        fd = -1;
+    }
+};
+
+// CRC-32 (IEEE) used to detect torn or corrupt log records
+inline uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+    static const auto table = [] {
+        array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// WriteAheadLog class - durable record of every committed change
+// Records are appended to an in-memory buffer while the change's locks are
+// held, then a flusher thread writes whole batches and issues one fdatasync
+// per batch (group commit). Callers wait for their record's sequence number
+// to become durable. After a batch starts waiting, the flusher gives other
+// operations up to commitDelay to join it, trading a little latency for
+// fewer syncs; it stops waiting early once every pending record's writer is
+// already blocked on it, since no more can arrive from them.
+//
+// File layout (native byte order): a LogHeader naming the state the log
+// starts from, then records of [u32 payload length][u32 crc32][u8 kind][payload].
+class WriteAheadLog {
+public:
+    enum class RecordKind : uint8_t {
+        CUSTOMER = 1, // five strings: first name, last name, email, phone, address
+        ACCOUNT = 2,  // AccountRecord, then the opening TransactionRecord
+        POSTING = 3   // u32 balance count, u32 record count, {u32 handle, i64 cents} x balances,
+                      // TransactionRecord x records
+    };
+
+    struct LogHeader {
+        static constexpr char magicText[] = "BANKWAL";
+        static const uint32_t currentVersion = 2; // ledger records as in snapshot version 2
+
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t baseCustomers;
+        uint64_t baseAccounts;
+        uint64_t baseTransactions;
+    };
+
+    static const size_t recordHeaderSize = 2 * sizeof(uint32_t) + 1;
+
+    // Payload under construction
+    class Record {
+    private:
+        vector<char> bytes;
+
+    public:
+        void clear() { bytes.clear(); }
+        const char* data() const { return bytes.data(); }
+        size_t size() const { return bytes.size(); }
+
+        void put(const void* data, size_t size) {
+            const char* start = static_cast<const char*>(data);
+            bytes.insert(bytes.end(), start, start + size);
+        }
+
+        template <typename T>
+        void put(const T& value) { put(&value, sizeof(T)); }
+
+        void putString(string_view text) {
+            put(static_cast<uint32_t>(text.size()));
+            put(text.data(), text.size());
+        }
+    };
+
+private:
+    static const size_t flushThreshold = 1 << 20;
+
+    int fd;
+    string filename;
+    chrono::microseconds commitDelay;
+
+    mutex logMutex;               // guards everything below
+    condition_variable pendingReady;
+    condition_variable durableReady;
+    vector<char> pending;
+    size_t pendingRecords;
+    size_t pendingWaiters;        // callers blocked on a record still in pending
+    uint64_t appendedLsn;
+    uint64_t swappedLsn;          // last record handed to the flusher
+    uint64_t durableLsn;
+    uint64_t generation;          // bumped by reset(); batches from older generations are dropped
+    bool stopping;
+    bool failed;
+
+    mutex fileMutex;              // serializes writes to the file with reset()
+    thread flusher;
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw BankException("Cannot write " + filename);
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    void writeHeader(uint64_t customers, uint64_t accounts, uint64_t transactions) {
+        LogHeader header{};
+        memcpy(header.magic, LogHeader::magicText, sizeof(header.magic));
+        header.version = LogHeader::currentVersion;
+        header.baseCustomers = customers;
+        header.baseAccounts = accounts;
+        header.baseTransactions = transactions;
+        if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0) {
+            throw BankException("Cannot reset " + filename);
+        }
+        writeAll(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (fdatasync(fd) != 0) {
+            throw BankException("Cannot sync " + filename);
+        }
+    }
+
+    void flushLoop() {
+        vector<char> writing;
+        unique_lock<mutex> lock(logMutex);
+        while (true) {
+            pendingReady.wait(lock, [&] { return stopping || !pending.empty(); });
+            if (pending.empty()) {
+                break;
+            }
+            if (!stopping && commitDelay.count() > 0 && pending.size() < flushThreshold) {
+                pendingReady.wait_for(lock, commitDelay, [&] {
+                    return stopping || pending.size() >= flushThreshold || pendingWaiters >= pendingRecords;
+                });
+            }
+            writing.swap(pending);
+            pendingRecords = 0;
+            pendingWaiters = 0;
+            swappedLsn = appendedLsn;
+            uint64_t batchEnd = appendedLsn;
+            uint64_t batchGeneration = generation;
+            lock.unlock();
+
+            bool written = true;
+            {
+                lock_guard<mutex> file(fileMutex);
+                bool current;
+                {
+                    lock_guard<mutex> state(logMutex);
+                    current = batchGeneration == generation;
+                }
+                try {
+                    if (current) {
+                        writeAll(writing.data(), writing.size());
+                        written = fdatasync(fd) == 0;
+                    }
+                }
+                catch (const BankException&) {
+                    written = false;
+                }
+            }
+            writing.clear();
+
+            lock.lock();
+            if (written) {
+                durableLsn = max(durableLsn, batchEnd);
+            } else {
+                failed = true;
+            }
+            durableReady.notify_all();
+        }
+    }
+
+public:
+    // Opens the log for appending. validLength is the length of the intact
+    // prefix found by replay (0 starts a new log whose base is the given state);
+    // anything after it, such as a torn final record, is discarded.
+    WriteAheadLog(const string& path, chrono::microseconds delay, uint64_t validLength,
+                  uint64_t customers, uint64_t accounts, uint64_t transactions)
+        : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644)), filename(path), commitDelay(delay),
+          pendingRecords(0), pendingWaiters(0), appendedLsn(0), swappedLsn(0), durableLsn(0), generation(0),
+          stopping(false), failed(false) {
+        if (fd < 0) {
+            throw BankException("Cannot open " + filename + " for writing");
+        }
+        try {
+            if (validLength == 0) {
+                writeHeader(customers, accounts, transactions);
+            } else if (ftruncate(fd, static_cast<off_t>(validLength)) != 0 ||
+                       lseek(fd, 0, SEEK_END) != static_cast<off_t>(validLength)) {
+                throw BankException("Cannot truncate " + filename);
+            }
+        }
+        catch (...) {
+            ::close(fd);
+            throw;
+        }
+        flusher = thread(&WriteAheadLog::flushLoop, this);
+    }
+
+    ~WriteAheadLog() {
+        {
+            lock_guard<mutex> lock(logMutex);
+            stopping = true;
+        }
+        pendingReady.notify_one();
+        flusher.join();
+        ::close(fd);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Queues a record and returns its sequence number for waitDurable()
+    uint64_t append(RecordKind kind, const Record& record) {
+        uint32_t header[2] = { static_cast<uint32_t>(record.size()), 0 };
+        uint8_t kindByte = static_cast<uint8_t>(kind);
+        header[1] = crc32(record.data(), record.size(), crc32(reinterpret_cast<const char*>(&kindByte), 1));
+
+        lock_guard<mutex> lock(logMutex);
+        bool wasEmpty = pending.empty();
+        const char* headerBytes = reinterpret_cast<const char*>(header);
+        pending.insert(pending.end(), headerBytes, headerBytes + sizeof(header));
+        pending.push_back(static_cast<char>(kindByte));
+        pending.insert(pending.end(), record.data(), record.data() + record.size());
+        pendingRecords++;
+        if (wasEmpty || pending.size() >= flushThreshold) {
+            pendingReady.notify_one();
+        }
+        return ++appendedLsn;
+    }
+
+    void waitDurable(uint64_t lsn) {
+        unique_lock<mutex> lock(logMutex);
+        if (lsn > swappedLsn && ++pendingWaiters >= pendingRecords) {
+            pendingReady.notify_one();
+        }
+        durableReady.wait(lock, [&] { return durableLsn >= lsn || failed; });
+        if (durableLsn < lsn) {
+            throw BankException("Write-ahead log failed; the change is not durable");
+        }
+    }
+
+    // Starts the log afresh from the given state, e.g. once a snapshot of it is
+    // safely on disk; records not yet written are covered by that state
+    void reset(uint64_t customers, uint64_t accounts, uint64_t transactions) {
+        lock_guard<mutex> file(fileMutex);
+        {
+            lock_guard<mutex> lock(logMutex);
+            pending.clear();
+            pendingRecords = 0;
+            pendingWaiters = 0;
+            swappedLsn = appendedLsn;
+            durableLsn = appendedLsn;
+            generation++;
+        }
+        durableReady.notify_all();
+        writeHeader(customers, accounts, transactions);
+    }
+};
+
+// BankSummary - totals the Bank maintains incrementally, so reading them costs
+// the same regardless of how many accounts or transactions exist
+struct BankSummary {
+    size_t customers = 0;
+    uint32_t savingsAccounts = 0;
+    uint32_t checkingAccounts = 0;
+    uint32_t loanAccounts = 0;
+    uint32_t activeAccounts = 0;
+    Money totalDeposits;  // savings and checking balances
+    Money loanExposure;   // outstanding loan balances
+    Money overdrawn;      // magnitude of negative savings and checking balances
+    uint64_t transactions = 0;
+    array<uint64_t, transactionTypeCount> transactionsByType{};
+};
+
+// Bytes behind one part of a bank's data
+struct MemoryComponent {
+    const char* name;
+    size_t bytes;
+};
+
+// Memory held by a bank's customers, accounts and transactions, by component
+// (from Bank::memoryUsage). Counts what the bank has allocated, including
+// reserved chunk directories and spare vector capacity, but not allocator
+// overhead; pages of a reserved chunk that were never written may not be resident.
+struct MemoryUsage {
+    size_t customers = 0;
+    size_t accounts = 0;
+    size_t transactions = 0;
+    vector<MemoryComponent> customerParts;
+    vector<MemoryComponent> accountParts;
+    vector<MemoryComponent> transactionParts;
+
+    static size_t total(const vector<MemoryComponent>& parts) {
+        size_t bytes = 0;
+        for (const MemoryComponent& part : parts) {
+            bytes += part.bytes;
+        }
+        return bytes;
+    }
+
+    size_t total() const { return total(customerParts) + total(accountParts) + total(transactionParts); }
+};
+
+// Bank class - Main management class
+// Customers are stored densely by handle index and accounts live in the
+// type-partitioned AccountStore, so every lookup is a bounds check plus an
+// array access; string IDs are parsed once at the edge. Operations dispatch on
+// the handle's type bits to the concrete table, so no virtual call is made on
+// the hot path; Account objects are only created as views for callers that
+// ask for them.
+//
+// Thread safety: the customer directory and account creation are guarded by a
+// shared mutex (exclusive only while creating). Account lookups never lock:
+// table storage never moves and new accounts are published atomically. Account
+// state is guarded by striped per-account mutexes, and operations touching two
+// accounts always lock the lower stripe first, so concurrent opposite-direction
+// transfers cannot deadlock.
+class Bank {
+private:
+    struct alignas(64) AccountLock {
+        mutex guard;
+    };
+
+    // Holds the stripes for two accounts, acquired in stripe order
+    class AccountPairLock {
+    private:
+        mutex* first;
+        mutex* second;
+
+    public:
+        AccountPairLock(mutex& a, mutex& b) : first(&a), second(&b) {
+            if (second < first) swap(first, second);
+            first->lock();
+            if (second != first) second->lock();
+        }
+        ~AccountPairLock() {
+            if (second != first) second->unlock();
+            first->unlock();
+        }
+        AccountPairLock(const AccountPairLock&) = delete;
+        AccountPairLock& operator=(const AccountPairLock&) = delete;
+    };
+
+    static const size_t lockStripes = 1024;
+
+    string bankName;
+    StringArena customerText;
+    vector<shared_ptr<Customer>> customers;
+    CustomerIndex customerIndex{ customers };
+    AccountStore store;
+    TransactionLedger ledger;
+    uint32_t initialDepositRef;
+    uint32_t loanDisbursementRef;
+    uint32_t monthlyInterestRef;
+    uint32_t overdraftFeeRef;
+    mutable shared_mutex directoryMutex;
+    mutable array<AccountLock, lockStripes> accountLocks;
+    unique_ptr<WriteAheadLog> wal; // set before the bank is shared between threads
+
+    mutex& lockFor(AccountHandle accountId) const {
+        return accountLocks[accountId.index() & (lockStripes - 1)].guard;
+    }
+
+    // The distinct accounts a group of operations uses, each resolved once
+    static constexpr uint32_t noSlot = UINT32_MAX;
+    struct ResolvedAccounts {
+        vector<AccountHandle> accounts; // known accounts, in account order
+        vector<uint32_t> rows;          // table row of each account
+        vector<uint32_t> slots;         // per use position: index into accounts, or noSlot if unknown
+    };
+
+    // uses holds (account value << 32 | use position) pairs, positions below
+    // positionCount; sorting them groups each account's uses, so every
+    // distinct account is resolved once
+    ResolvedAccounts resolveAccounts(vector<uint64_t>& uses, size_t positionCount) const {
+        sort(uses.begin(), uses.end());
+        ResolvedAccounts resolved;
+        resolved.slots.assign(positionCount, noSlot);
+        AccountHandle previous{ 0 };
+        bool previousKnown = false;
+        for (size_t u = 0; u < uses.size(); ++u) {
+            AccountHandle accountId{ static_cast<uint32_t>(uses[u] >> 32) };
+            if (u == 0 || previous != accountId) {
+                uint32_t row;
+                previous = accountId;
+                previousKnown = store.resolve(accountId, row);
+                if (previousKnown) {
+                    resolved.accounts.push_back(accountId);
+                    resolved.rows.push_back(row);
+                }
+            }
+            if (previousKnown) {
+                resolved.slots[static_cast<uint32_t>(uses[u])] = static_cast<uint32_t>(resolved.accounts.size() - 1);
+            }
+        }
+        return resolved;
+    }
+
+    // Takes the stripes of a group of accounts once each, in stripe order like AccountPairLock
+    vector<unique_lock<mutex>> lockAccounts(const vector<AccountHandle>& accounts) const {
+        vector<mutex*> stripes;
+        stripes.reserve(accounts.size());
+        for (AccountHandle accountId : accounts) {
+            stripes.push_back(&lockFor(accountId));
+        }
+        sort(stripes.begin(), stripes.end());
+        stripes.erase(unique(stripes.begin(), stripes.end()), stripes.end());
+        vector<unique_lock<mutex>> locks;
+        locks.reserve(stripes.size());
+        for (mutex* stripe : stripes) {
+            locks.emplace_back(*stripe);
+        }
+        return locks;
+    }
+
+    // Takes every account stripe in order, stopping all account operations
+    vector<unique_lock<mutex>> lockAllAccounts() const {
+        vector<unique_lock<mutex>> stripes;
+        stripes.reserve(lockStripes);
+        for (auto& stripe : accountLocks) {
+            stripes.emplace_back(stripe.guard);
+        }
+        return stripes;
+    }
+
+    // Appends a customer and files it in the lookup indexes; expects
+    // directoryMutex to be held exclusively
+    CustomerHandle addCustomer(const string& firstName, const string& lastName,
+                               const string& email, const string& phone, const string& address) {
+        CustomerHandle customerId{ static_cast<uint32_t>(customers.size()) };
+        customers.push_back(make_shared<Customer>(customerId, customerText, firstName, lastName, email, phone,
+                                                  address));
+        customerIndex.add(*customers.back());
+        return customerId;
+    }
+
+    // Expects directoryMutex to be held by the caller
+    vector<shared_ptr<Customer>> customersAt(const vector<uint32_t>& numbers) const {
+        vector<shared_ptr<Customer>> result;
+        result.reserve(numbers.size());
+        for (uint32_t number : numbers) {
+            result.push_back(customers[number]);
+        }
+        return result;
+    }
+
+    // Expects directoryMutex to be held by the caller
+    Customer* customerAt(CustomerHandle customerId) const {
+        return customerId.index() < customers.size() ? customers[customerId.index()].get() : nullptr;
+    }
+
+    uint32_t requireRow(AccountHandle accountId) const {
+        uint32_t row;
+        if (!store.resolve(accountId, row)) {
+            throw AccountNotFoundException();
+        }
+        return row;
+    }
+
+    static AccountHandle parseAccountId(const string& accountId) {
+        AccountHandle handle;
+        if (!AccountHandle::parse(accountId, handle)) {
+            throw AccountNotFoundException();
+        }
+        return handle;
+    }
+
+    static CustomerHandle parseCustomerId(const string& customerId) {
+        CustomerHandle handle;
+        if (!CustomerHandle::parse(customerId, handle)) {
+            throw AccountNotFoundException();
+        }
+        return handle;
+    }
+
+    // Records the opening transaction of an account just added to the store,
+    // then publishes it; returns the log sequence number to wait on
+    uint64_t registerAccount(AccountHandle accountId, Customer& customer,
+                             Money openingAmount, uint32_t descriptionRef) {
+        AccountColumns& columns = store.columnsFor(accountId.type());
+        uint32_t row = store.rowAt(accountId.index());
+        customer.addAccount(accountId);
+
+        // A loan opens by paying out its amount, other accounts by receiving their first deposit
+        auto transaction = accountId.type() == AccountType::LOAN
+                               ? ledger.append(accountId, AccountHandle::external(), openingAmount,
+                                               TransactionType::LOAN_DISBURSEMENT, descriptionRef)
+                               : ledger.append(AccountHandle::bank(), accountId, openingAmount,
+                                               TransactionType::DEPOSIT, descriptionRef);
+        addHistory(columns, row, transaction);
+        store.publish();
+
+        uint64_t lsn = 0;
+        if (wal) {
+            WriteAheadLog::Record& record = logScratch();
+            record.put(store.recordAt(accountId.index()));
+            record.put(ledger.at(transaction).toRecord());
+            lsn = wal->append(WriteAheadLog::RecordKind::ACCOUNT, record);
+        }
+
+        BankEvents::publish(BankEventType::ACCOUNT_OPENED, accountId, openingAmount, columns.balanceAt(row));
+        return lsn;
+    }
+
+    void addHistory(AccountColumns& columns, uint32_t row, TransactionLedger::Index index) {
+        columns.history[row].push_back(HistoryEntry::of(index, ledger.at(index)));
+    }
+
+    // The overdraft fee a withdrawal took from a balance besides the amount itself
+    static int64_t feeCharged(int64_t before, Money amount, int64_t after) {
+        return before - amount.getCents() - after;
+    }
+
+    TransactionLedger::Entry feeEntry(AccountHandle accountId, int64_t fee) const {
+        return TransactionLedger::Entry{ accountId, AccountHandle::bank(), Money::fromCents(fee),
+                                         TransactionType::FEE, overdraftFeeRef };
+    }
+
+    // Appends an operation's record followed, if the operation also charged the
+    // account a fee, by the fee's record; records is set to how many were appended
+    TransactionLedger::Index appendWithFee(const TransactionLedger::Entry& entry, AccountHandle charged,
+                                           int64_t fee, size_t& records) {
+        if (fee == 0) {
+            records = 1;
+            return ledger.append(entry.from, entry.to, entry.amount, entry.type, entry.descriptionRef);
+        }
+        records = 2;
+        return ledger.appendBulk({ entry, feeEntry(charged, fee) });
+    }
+
+    // Position range [begin, end) of an account's history entries inside the
+    // query's time range; entries are in time order, so this is two binary searches
+    static pair<size_t, size_t> timeRange(const vector<HistoryEntry>& entries, const HistoryQuery& query) {
+        auto before = [](const HistoryEntry& entry, int64_t time) { return entry.timestamp < time; };
+        size_t begin = lower_bound(entries.begin(), entries.end(), query.from, before) - entries.begin();
+        size_t end = lower_bound(entries.begin(), entries.end(), query.until, before) - entries.begin();
+        return { begin, max(begin, end) };
+    }
+
+    static WriteAheadLog::Record& logScratch() {
+        static thread_local WriteAheadLog::Record record;
+        record.clear();
+        return record;
+    }
+
+    // Logs the current balances of the given accounts and the ledger records
+    // [first, first + records). Called with those accounts' locks held, so each
+    // account's changes reach the log in the order they were applied. Returns
+    // the sequence number to wait on once the locks are released (0 if there
+    // is no log).
+    uint64_t logPosting(const AccountHandle* accountIds, size_t accountCount,
+                        TransactionLedger::Index first, size_t records) {
+        if (!wal) {
+            return 0;
+        }
+        WriteAheadLog::Record& record = logScratch();
+        record.put(static_cast<uint32_t>(accountCount));
+        record.put(static_cast<uint32_t>(records));
+        for (size_t i = 0; i < accountCount; ++i) {
+            uint32_t row = store.rowAt(accountIds[i].index());
+            record.put(accountIds[i].value);
+            record.put(store.columnsFor(accountIds[i].type()).balance[row]);
+        }
+        for (size_t i = 0; i < records; ++i) {
+            record.put(ledger.at(first + i).toRecord());
+        }
+        return wal->append(WriteAheadLog::RecordKind::POSTING, record);
+    }
+
+    void awaitDurable(uint64_t lsn) {
+        if (lsn != 0) {
+            wal->waitDurable(lsn);
+        }
+    }
+
+    // Adds ledger records [first, size()) to the histories of the accounts they
+    // touch; returns the largest transaction ID among them
+    uint64_t indexHistory(TransactionLedger::Index first) {
+        uint64_t lastTransactionId = 0;
+        for (TransactionLedger::Index index = first; index < ledger.size(); ++index) {
+            const Transaction& transaction = ledger.at(index);
+            for (AccountHandle accountId : { transaction.getFrom(), transaction.getTo() }) {
+                uint32_t row;
+                if (!accountId.isAccount()) continue;
+                if (!store.resolve(accountId, row)) {
+                    throw BankException("Transaction " + to_string(transaction.getTransactionId()) +
+                                        " refers to an unknown account");
+                }
+                addHistory(store.columnsFor(accountId.type()), row, index);
+            }
+            lastTransactionId = max(lastTransactionId, transaction.getTransactionId());
+        }
+        return lastTransactionId;
+    }
+
+    // Replays the ledger and compares it with the stored balances; expects every lock to be held
+    LedgerAudit replayLedger() const {
+        size_t workers = max(1u, thread::hardware_concurrency());
+        LedgerReplay::Result replay = LedgerReplay::run(ledger, store, workers);
+        LedgerAudit audit;
+        audit.records = replay.records;
+        audit.accounts = replay.balances.size();
+        for (uint32_t index = 0; index < replay.balances.size(); ++index) {
+            AccountHandle accountId = store.handleAt(index);
+            int64_t stored = store.columnsFor(accountId.type()).balance[store.rowAt(index)];
+            if (stored != replay.balances[index]) {
+                audit.mismatches.push_back(LedgerMismatch{ accountId, Money::fromCents(stored),
+                                                           Money::fromCents(replay.balances[index]) });
+            }
+        }
+        return audit;
+    }
+
+    // Recomputes each loan's interest due and months charged by replaying its
+    // disbursement, interest charges and payments from the ledger, for states
+    // restored from snapshots or logs, which carry balances only. Expects every
+    // lock to be held.
+    void rebuildLoanState() {
+        LoanTable& loans = store.loans;
+        for (uint32_t row = 0; row < loans.rows; ++row) {
+            AccountHandle loan = loans.handleAt(row);
+            int64_t balance = 0;
+            loans.resetRepayment(row);
+            for (const HistoryEntry& entry : loans.history[row]) {
+                const Transaction& transaction = ledger.at(entry.index());
+                int64_t cents = transaction.getAmount().getCents();
+                if (transaction.getType() == TransactionType::LOAN_DISBURSEMENT) {
+                    balance -= cents;
+                } else if (transaction.getType() == TransactionType::INTEREST_CHARGE) {
+                    loans.accrue(row, cents);
+                    balance -= cents;
+                } else if (transaction.getTo() == loan) {
+                    loans.splitPayment(row, balance, transaction.getAmount());
+                    balance += cents;
+                }
+            }
+        }
+    }
+
+    // Applies one intact log record; expects the directory and every account lock to be held
+    // Adds what one logged record creates to the given counts, without applying it
+    static void countLogRecord(WriteAheadLog::RecordKind kind, SnapshotReader record, uint64_t& customerCount,
+                               uint64_t& accountCount, uint64_t& transactionCount) {
+        switch (kind) {
+            case WriteAheadLog::RecordKind::CUSTOMER:
+                customerCount++;
+                break;
+            case WriteAheadLog::RecordKind::ACCOUNT:
+                accountCount++;
+                transactionCount++;
+                break;
+            case WriteAheadLog::RecordKind::POSTING:
+                record.read<uint32_t>();
+                transactionCount += record.read<uint32_t>();
+                break;
+            default:
+                throw BankException("Write-ahead log contains an unknown record kind");
+        }
+    }
+
+    void applyLogRecord(WriteAheadLog::RecordKind kind, SnapshotReader& record,
+                        const vector<uint32_t>& descriptionRefs, uint64_t& lastTransactionId) {
+        TransactionLedger::Index first = ledger.size();
+        switch (kind) {
+            case WriteAheadLog::RecordKind::CUSTOMER: {
+                string fields[5];
+                for (auto& field : fields) {
+                    field = record.readString();
+                }
+                addCustomer(fields[0], fields[1], fields[2], fields[3], fields[4]);
+                return;
+            }
+            case WriteAheadLog::RecordKind::ACCOUNT: {
+                AccountRecord account = record.read<AccountRecord>();
+                if (account.owner >= customers.size()) {
+                    throw BankException("Logged account has an unknown owner");
+                }
+                customers[account.owner]->addAccount(store.restore(account));
+                store.publish();
+                ledger.restore(record.readArray(1, sizeof(TransactionRecord)), 1, descriptionRefs);
+                break;
+            }
+            case WriteAheadLog::RecordKind::POSTING: {
+                uint32_t balances = record.read<uint32_t>();
+                uint32_t records = record.read<uint32_t>();
+                for (uint32_t i = 0; i < balances; ++i) {
+                    AccountHandle accountId{ record.read<uint32_t>() };
+                    int64_t cents = record.read<int64_t>();
+                    uint32_t row;
+                    if (!store.resolve(accountId, row)) {
+                        throw BankException("Logged posting refers to an unknown account");
+                    }
+                    store.columnsFor(accountId.type()).setBalance(row, cents);
+                }
+                ledger.restore(record.readArray(records, sizeof(TransactionRecord)), records, descriptionRefs);
+                break;
+            }
+            default:
+                throw BankException("Write-ahead log contains an unknown record kind");
+        }
+        lastTransactionId = max(lastTransactionId, indexHistory(first));
+    }
+
+public:
+    Bank(const string& name) : bankName(name) {
+        initialDepositRef = ledger.intern("Initial deposit");
+        loanDisbursementRef = ledger.intern("Loan disbursement");
+        monthlyInterestRef = ledger.intern("Monthly interest");
+        overdraftFeeRef = ledger.intern("Overdraft fee");
+    }
+
+    const TransactionLedger& getLedger() const { return ledger; }
+
+    // Reads a balance under its account lock
+    Money balanceOf(const Account& account) const {
+        lock_guard<mutex> lock(lockFor(account.getHandle()));
+        return account.getBalance();
+    }
+
+    // Customer management
+    CustomerHandle createCustomerHandle(const string& firstName, const string& lastName,
+                                        const string& email, const string& phone, const string& address) {
+        unique_lock<shared_mutex> directory(directoryMutex);
+        CustomerHandle customerId = addCustomer(firstName, lastName, email, phone, address);
+
+        uint64_t lsn = 0;
+        if (wal) {
+            WriteAheadLog::Record& record = logScratch();
+            for (const string* field : { &firstName, &lastName, &email, &phone, &address }) {
+                record.putString(*field);
+            }
+            lsn = wal->append(WriteAheadLog::RecordKind::CUSTOMER, record);
+        }
+
+        if (BankEvents::enabled()) {
+            BankEvents::publishNamed(BankEventType::CUSTOMER_CREATED, customerId.toString());
+        }
+        directory.unlock();
+        awaitDurable(lsn);
+        return customerId;
+    }
+
+    string createCustomer(const string& firstName, const string& lastName,
+                         const string& email, const string& phone, const string& address) {
+        return createCustomerHandle(firstName, lastName, email, phone, address).toString();
+    }
+
+    shared_ptr<Customer> findCustomer(CustomerHandle customerId) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        return customerId.index() < customers.size() ? customers[customerId.index()] : nullptr;
+    }
+
+    shared_ptr<Customer> findCustomer(const string& customerId) const {
+        CustomerHandle handle;
+        return CustomerHandle::parse(customerId, handle) ? findCustomer(handle) : nullptr;
+    }
+
+    // Customers with exactly this email, in customer ID order
+    vector<shared_ptr<Customer>> findCustomersByEmail(const string& email) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        return customersAt(customerIndex.findContact(CustomerIndex::Field::EMAIL, email));
+    }
+
+    // Customers with exactly this phone number, in customer ID order
+    vector<shared_ptr<Customer>> findCustomersByPhone(const string& phone) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        return customersAt(customerIndex.findContact(CustomerIndex::Field::PHONE, phone));
+    }
+
+    // Up to limit customers whose last name starts with prefix (ignoring case), by last name
+    vector<shared_ptr<Customer>> findCustomersByLastName(const string& prefix, size_t limit = 50) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        return customersAt(customerIndex.findLastNamePrefix(prefix, limit));
+    }
+
+    // Account management
+    AccountHandle createSavingsAccount(CustomerHandle customerId, Money initialDeposit) {
+        unique_lock<shared_mutex> directory(directoryMutex);
+        Customer* customer = customerAt(customerId);
+        if (!customer) {
+            throw AccountNotFoundException();
+        }
+        AccountHandle accountId = store.addSavings(customerId, initialDeposit);
+        uint64_t lsn = registerAccount(accountId, *customer, initialDeposit, initialDepositRef);
+        directory.unlock();
+        awaitDurable(lsn);
+        return accountId;
+    }
+
+    AccountHandle createCheckingAccount(CustomerHandle customerId, Money initialDeposit) {
+        unique_lock<shared_mutex> directory(directoryMutex);
+        Customer* customer = customerAt(customerId);
+        if (!customer) {
+            throw AccountNotFoundException();
+        }
+        AccountHandle accountId = store.addChecking(customerId, initialDeposit);
+        uint64_t lsn = registerAccount(accountId, *customer, initialDeposit, initialDepositRef);
+        directory.unlock();
+        awaitDurable(lsn);
+        return accountId;
+    }
+
+    AccountHandle createLoanAccount(CustomerHandle customerId, Money loanAmount, int termMonths) {
+        unique_lock<shared_mutex> directory(directoryMutex);
+        Customer* customer = customerAt(customerId);
+        if (!customer) {
+            throw AccountNotFoundException();
+        }
+        AccountHandle accountId = store.addLoan(customerId, loanAmount, termMonths);
+        uint64_t lsn = registerAccount(accountId, *customer, loanAmount, loanDisbursementRef);
+        directory.unlock();
+        awaitDurable(lsn);
+        return accountId;
+    }
+
+    string createSavingsAccount(const string& customerId, Money initialDeposit) {
+        return createSavingsAccount(parseCustomerId(customerId), initialDeposit).toString();
+    }
+
+    string createCheckingAccount(const string& customerId, Money initialDeposit) {
+        return createCheckingAccount(parseCustomerId(customerId), initialDeposit).toString();
+    }
+
+    string createLoanAccount(const string& customerId, Money loanAmount, int termMonths) {
+        return createLoanAccount(parseCustomerId(customerId), loanAmount, termMonths).toString();
+    }
+
+    shared_ptr<Account> findAccount(AccountHandle accountId) const {
+        return BankMetrics::measure(BankOperation::FIND_ACCOUNT, [&] {
+            return store.view(accountId);
+        });
+    }
+
+    shared_ptr<Account> findAccount(const string& accountId) const {
+        AccountHandle handle;
+        return AccountHandle::parse(accountId, handle) ? findAccount(handle) : nullptr;
+    }
+
+    // Transaction operations
+    // With a write-ahead log attached, each operation returns once its change is durable.
+    // The try* forms report a rejected operation (unknown account, bad amount,
+    // insufficient funds, a withdrawal from a loan) as a status instead of
+    // throwing, so a decline costs about as much as an approval; the throwing
+    // forms below are built on them.
+    OperationResult tryDeposit(AccountHandle accountId, Money amount) {
+        return BankMetrics::measure(BankOperation::DEPOSIT, [&] {
+            uint32_t row;
+            if (!store.resolve(accountId, row)) {
+                return OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() };
+            }
+            if (amount <= Money()) {
+                return OperationResult{ OperationStatus::INVALID_AMOUNT, Money() };
+            }
+            uint64_t lsn;
+            Money balance;
+            {
+                lock_guard<mutex> lock(lockFor(accountId));
+                auto transaction = store.visit(accountId, row, [&](auto& table, uint32_t tableRow) {
+                    // Record transaction
+                    auto index = ledger.append(AccountHandle::external(), accountId, amount, TransactionType::DEPOSIT);
+                    table.deposit(tableRow, amount);
+                    balance = table.balanceAt(tableRow);
+                    addHistory(table, tableRow, index);
+                    return index;
+                });
+                lsn = logPosting(&accountId, 1, transaction, 1);
+            }
+            awaitDurable(lsn);
+            return OperationResult{ OperationStatus::OK, balance };
+        });
+    }
+
+    OperationResult tryWithdraw(AccountHandle accountId, Money amount) {
+        return BankMetrics::measure(BankOperation::WITHDRAW, [&] {
+            uint32_t row;
+            if (!store.resolve(accountId, row)) {
+                return OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() };
+            }
+            uint64_t lsn = 0;
+            OperationResult result;
+            {
+                lock_guard<mutex> lock(lockFor(accountId));
+                store.visit(accountId, row, [&](auto& table, uint32_t tableRow) {
+                    int64_t before = table.balance[tableRow], after = before;
+                    result.status = table.balanceAfterWithdrawal(before, amount, after);
+                    size_t records = 0;
+                    TransactionLedger::Index first = 0;
+                    if (result.ok()) {
+                        // Record transaction, and the overdraft fee if one will be charged
+                        first = appendWithFee(TransactionLedger::Entry{ accountId, AccountHandle::external(), amount,
+                                                                        TransactionType::WITHDRAWAL, 0 },
+                                              accountId, feeCharged(before, amount, after), records);
+                    }
+                    table.withdraw(tableRow, amount); // does what was decided; publishes a loan's refusal
+                    result.balance = table.balanceAt(tableRow);
+                    if (result.ok()) {
+                        for (size_t i = 0; i < records; ++i) {
+                            addHistory(table, tableRow, first + i);
+                        }
+                        lsn = logPosting(&accountId, 1, first, records);
+                    }
+                });
+            }
+            awaitDurable(lsn);
+            return result;
+        });
+    }
+
+    OperationResult tryTransfer(AccountHandle fromAccountId, AccountHandle toAccountId, Money amount) {
+        return BankMetrics::measure(BankOperation::TRANSFER, [&] {
+            uint32_t fromRow, toRow;
+            if (!store.resolve(fromAccountId, fromRow) || !store.resolve(toAccountId, toRow)) {
+                return OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() };
+            }
+            uint64_t lsn = 0;
+            OperationResult result;
+            {
+                AccountPairLock lock(lockFor(fromAccountId), lockFor(toAccountId));
+
+                AccountColumns& from = store.columnsFor(fromAccountId.type());
+                int64_t before = from.balance[fromRow], after = before;
+                result.status = store.visit(fromAccountId, fromRow, [&](auto& table, uint32_t) {
+                    return table.balanceAfterWithdrawal(before, amount, after);
+                });
+                size_t records = 0;
+                TransactionLedger::Index transaction = 0;
+                if (result.ok()) {
+                    // Record transaction for both accounts, and the source's overdraft fee
+                    transaction = appendWithFee(TransactionLedger::Entry{ fromAccountId, toAccountId, amount,
+                                                                          TransactionType::TRANSFER, 0 },
+                                                fromAccountId, feeCharged(before, amount, after), records);
+                }
+                store.visit(fromAccountId, fromRow, [&](auto& table, uint32_t row) {
+                    table.withdraw(row, amount); // does what was decided; publishes a loan's refusal
+                });
+                result.balance = from.balanceAt(fromRow);
+                if (result.ok()) {
+                    store.visit(toAccountId, toRow, [&](auto& table, uint32_t row) {
+                        table.deposit(row, amount);
+                    });
+                    addHistory(from, fromRow, transaction);
+                    addHistory(store.columnsFor(toAccountId.type()), toRow, transaction);
+                    if (records == 2) {
+                        addHistory(from, fromRow, transaction + 1);
+                    }
+                    AccountHandle touched[] = { fromAccountId, toAccountId };
+                    lsn = logPosting(touched, 2, transaction, records);
+
+                    BankEvents::publish(BankEventType::TRANSFER, fromAccountId, amount, result.balance, toAccountId);
+                }
+            }
+            awaitDurable(lsn);
+            return result;
+        });
+    }
+
+    void deposit(AccountHandle accountId, Money amount) {
+        throwOnFailure(tryDeposit(accountId, amount).status);
+    }
+
+    void withdraw(AccountHandle accountId, Money amount) {
+        throwOnFailure(tryWithdraw(accountId, amount).status);
+    }
+
+    void transfer(AccountHandle fromAccountId, AccountHandle toAccountId, Money amount) {
+        throwOnFailure(tryTransfer(fromAccountId, toAccountId, amount).status);
+    }
+
+    // Applies a batch of transfers all or nothing. Each account is resolved
+    // and locked once for the whole batch; the transfers are checked in order
+    // against running balances, so a transfer may spend money an earlier one
+    // in the batch brought in. If any transfer fails, a BatchTransferException
+    // names it and no account changes. Otherwise every balance is written once
+    // and the records are appended to the ledger in one bulk append.
+    void transferBatch(const vector<TransferInstruction>& transfers) {
+        BankMetrics::measure(BankOperation::TRANSFER_BATCH, [&] {
+            if (transfers.empty()) {
+                return;
+            }
+
+            // Resolve every distinct account once; a use's position is 2 * transfer
+            // for the source and one more for the destination. An unknown account
+            // fails the earliest transfer using it, which is reported only if no
+            // transfer before it fails.
+            vector<uint64_t> uses(transfers.size() * 2);
+            for (size_t i = 0; i < transfers.size(); ++i) {
+                uses[2 * i] = static_cast<uint64_t>(transfers[i].from.value) << 32 | (2 * i);
+                uses[2 * i + 1] = static_cast<uint64_t>(transfers[i].to.value) << 32 | (2 * i + 1);
+            }
+            ResolvedAccounts resolved = resolveAccounts(uses, uses.size());
+            const vector<AccountHandle>& accounts = resolved.accounts;
+            const vector<uint32_t>& rows = resolved.rows;
+            const vector<uint32_t>& slots = resolved.slots;
+            size_t firstUnknown = 0;
+            while (firstUnknown < transfers.size() && slots[2 * firstUnknown] != noSlot &&
+                   slots[2 * firstUnknown + 1] != noSlot) {
+                firstUnknown++;
+            }
+
+            vector<unique_lock<mutex>> locks = lockAccounts(accounts);
+
+            // Check the whole batch on scratch balances before touching an account
+            vector<int64_t> balances(accounts.size());
+            for (size_t slot = 0; slot < accounts.size(); ++slot) {
+                balances[slot] = store.columnsFor(accounts[slot].type()).balance[rows[slot]];
+            }
+            vector<int64_t> sourceBalances(BankEvents::enabled() ? transfers.size() : 0);
+            vector<int64_t> fees(transfers.size());
+            for (size_t i = 0; i < transfers.size(); ++i) {
+                if (i == firstUnknown) {
+                    throw BatchTransferException(i, statusMessage(OperationStatus::ACCOUNT_NOT_FOUND));
+                }
+                uint32_t from = slots[2 * i], to = slots[2 * i + 1];
+                int64_t before = balances[from];
+                OperationStatus status = store.visit(accounts[from], rows[from], [&](auto& table, uint32_t) {
+                    return table.balanceAfterWithdrawal(balances[from], transfers[i].amount, balances[from]);
+                });
+                if (status == OperationStatus::REFUSED) {
+                    throw BatchTransferException(i, "Withdrawals are not allowed from " + accounts[from].toString());
+                }
+                if (status != OperationStatus::OK) {
+                    throw BatchTransferException(i, statusMessage(status));
+                }
+                fees[i] = feeCharged(before, transfers[i].amount, balances[from]);
+                balances[to] += transfers[i].amount.getCents();
+                if (!sourceBalances.empty()) {
+                    sourceBalances[i] = balances[from];
+                }
+            }
+
+            // Apply: one bulk ledger append, then one balance write per account.
+            // Each transfer's record is followed by its overdraft fee's, if it charged one.
+            vector<TransactionLedger::Entry> entries;
+            entries.reserve(transfers.size());
+            for (size_t i = 0; i < transfers.size(); ++i) {
+                entries.push_back(TransactionLedger::Entry{ transfers[i].from, transfers[i].to, transfers[i].amount,
+                                                            TransactionType::TRANSFER, 0 });
+                if (fees[i] != 0) {
+                    entries.push_back(feeEntry(transfers[i].from, fees[i]));
+                }
+            }
+            TransactionLedger::Index first = ledger.appendBulk(entries);
+            // Loans only receive, so their net inflow is applied as one payment
+            for (size_t slot = 0; slot < accounts.size(); ++slot) {
+                AccountColumns& table = store.columnsFor(accounts[slot].type());
+                int64_t before = table.balance[rows[slot]];
+                if (accounts[slot].type() == AccountType::LOAN && balances[slot] != before) {
+                    store.loans.splitPayment(rows[slot], before, Money::fromCents(balances[slot] - before));
+                }
+                table.setBalance(rows[slot], balances[slot]);
+            }
+            TransactionLedger::Index index = first;
+            for (size_t i = 0; i < transfers.size(); ++i) {
+                uint32_t from = slots[2 * i], to = slots[2 * i + 1];
+                AccountColumns& source = store.columnsFor(accounts[from].type());
+                addHistory(source, rows[from], index);
+                addHistory(store.columnsFor(accounts[to].type()), rows[to], index++);
+                if (fees[i] != 0) {
+                    addHistory(source, rows[from], index++);
+                }
+            }
+            uint64_t lsn = logPosting(accounts.data(), accounts.size(), first, entries.size());
+
+            for (size_t i = 0; i < sourceBalances.size(); ++i) {
+                BankEvents::publish(BankEventType::TRANSFER, transfers[i].from, transfers[i].amount,
+                                    Money::fromCents(sourceBalances[i]), transfers[i].to);
+            }
+            locks.clear();
+            awaitDurable(lsn);
+        });
+    }
+
+    // Executes a group of independent requests as one unit of work: each
+    // account is resolved and locked once for the group, the requests then
+    // succeed or fail one by one in order (as the try* operations would), and
+    // the records of the whole group go to the ledger in one bulk append and
+    // to the log as one posting that is waited on once. results receives one
+    // result per request. The group is checked on scratch balances, so it
+    // takes effect whole or not at all; if this throws, results holds a result
+    // for every request if the group took effect (only its log write failed)
+    // and is empty if not.
+    void executeRequests(const vector<BankRequest>& requests, vector<OperationResult>& results) {
+        BankMetrics::measure(BankOperation::REQUEST_BATCH, [&] {
+            results.clear();
+            if (requests.empty()) {
+                return;
+            }
+
+            // Resolve every distinct account once; a request's position is 2 * request
+            // for its account and one more for a transfer's destination
+            vector<uint64_t> uses;
+            uses.reserve(requests.size() * 2);
+            for (size_t i = 0; i < requests.size(); ++i) {
+                uses.push_back(static_cast<uint64_t>(requests[i].account.value) << 32 | (2 * i));
+                if (requests[i].kind == BankRequest::Kind::TRANSFER) {
+                    uses.push_back(static_cast<uint64_t>(requests[i].to.value) << 32 | (2 * i + 1));
+                }
+            }
+            ResolvedAccounts resolved = resolveAccounts(uses, requests.size() * 2);
+            const vector<AccountHandle>& accounts = resolved.accounts;
+            const vector<uint32_t>& rows = resolved.rows;
+            const vector<uint32_t>& slots = resolved.slots;
+
+            vector<unique_lock<mutex>> locks = lockAccounts(accounts);
+            vector<OperationResult> outcomes(requests.size(),
+                                             OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() });
+            vector<int64_t> balances(accounts.size());
+            for (size_t slot = 0; slot < accounts.size(); ++slot) {
+                balances[slot] = store.columnsFor(accounts[slot].type()).balance[rows[slot]];
+            }
+            vector<TransactionLedger::Entry> entries;
+            vector<pair<uint32_t, uint32_t>> histories; // (slot, entry) pairs to index once appended
+            vector<uint8_t> changed(accounts.size());
+            auto record = [&](const TransactionLedger::Entry& entry, uint32_t slot, uint32_t otherSlot) {
+                histories.emplace_back(slot, static_cast<uint32_t>(entries.size()));
+                changed[slot] = 1;
+                if (otherSlot != noSlot) {
+                    histories.emplace_back(otherSlot, static_cast<uint32_t>(entries.size()));
+                    changed[otherSlot] = 1;
+                }
+                entries.push_back(entry);
+            };
+
+            // Decide every request in order on the scratch balances
+            for (size_t i = 0; i < requests.size(); ++i) {
+                const BankRequest& request = requests[i];
+                uint32_t slot = slots[2 * i];
+                uint32_t toSlot = slots[2 * i + 1];
+                if (slot == noSlot || (request.kind == BankRequest::Kind::TRANSFER && toSlot == noSlot)) {
+                    continue;
+                }
+                OperationResult& result = outcomes[i];
+                switch (request.kind) {
+                    case BankRequest::Kind::BALANCE:
+                        result.status = OperationStatus::OK;
+                        break;
+                    case BankRequest::Kind::DEPOSIT:
+                        if (request.amount <= Money()) {
+                            result.status = OperationStatus::INVALID_AMOUNT;
+                            break;
+                        }
+                        balances[slot] += request.amount.getCents();
+                        result.status = OperationStatus::OK;
+                        record(TransactionLedger::Entry{ AccountHandle::external(), accounts[slot], request.amount,
+                                                         TransactionType::DEPOSIT, 0 }, slot, noSlot);
+                        break;
+                    case BankRequest::Kind::WITHDRAW:
+                    case BankRequest::Kind::TRANSFER: {
+                        bool transfer = request.kind == BankRequest::Kind::TRANSFER;
+                        int64_t before = balances[slot];
+                        result.status = store.visit(accounts[slot], rows[slot], [&](auto& table, uint32_t) {
+                            return table.balanceAfterWithdrawal(before, request.amount, balances[slot]);
+                        });
+                        if (!result.ok()) {
+                            break;
+                        }
+                        int64_t fee = feeCharged(before, request.amount, balances[slot]);
+                        if (transfer) {
+                            balances[toSlot] += request.amount.getCents();
+                        }
+                        record(TransactionLedger::Entry{ accounts[slot], transfer ? accounts[toSlot] : AccountHandle::external(),
+                                                         request.amount,
+                                                         transfer ? TransactionType::TRANSFER : TransactionType::WITHDRAWAL, 0 },
+                                                         slot, transfer ? toSlot : noSlot);
+                        if (fee != 0) {
+                            record(feeEntry(accounts[slot], fee), slot, noSlot);
+                        }
+                        break;
+                    }
+                }
+                result.balance = Money::fromCents(balances[slot]);
+            }
+
+            TransactionLedger::Index first = entries.empty() ? 0 : ledger.appendBulk(entries);
+
+            // Apply them in the same order; each now does what was decided
+            for (size_t i = 0; i < requests.size(); ++i) {
+                const BankRequest& request = requests[i];
+                OperationStatus status = outcomes[i].status;
+                if (request.kind == BankRequest::Kind::BALANCE ||
+                    (status != OperationStatus::OK && status != OperationStatus::REFUSED)) {
+                    continue;
+                }
+                uint32_t slot = slots[2 * i];
+                if (request.kind == BankRequest::Kind::DEPOSIT) {
+                    store.visit(accounts[slot], rows[slot], [&](auto& table, uint32_t row) {
+                        table.deposit(row, request.amount);
+                    });
+                    continue;
+                }
+                store.visit(accounts[slot], rows[slot], [&](auto& table, uint32_t row) {
+                    table.withdraw(row, request.amount); // publishes the rejection of a refused one
+                });
+                if (status == OperationStatus::OK && request.kind == BankRequest::Kind::TRANSFER) {
+                    uint32_t toSlot = slots[2 * i + 1];
+                    Money sourceBalance = store.columnsFor(accounts[slot].type()).balanceAt(rows[slot]);
+                    store.visit(accounts[toSlot], rows[toSlot], [&](auto& table, uint32_t row) {
+                        table.deposit(row, request.amount);
+                    });
+                    BankEvents::publish(BankEventType::TRANSFER, accounts[slot], request.amount,
+                                        sourceBalance, accounts[toSlot]);
+                }
+            }
+            results.swap(outcomes);
+
+            uint64_t lsn = 0;
+            if (!entries.empty()) {
+                for (const auto& history : histories) {
+                    addHistory(store.columnsFor(accounts[history.first].type()), rows[history.first],
+                               first + history.second);
+                }
+                vector<AccountHandle> touched;
+                for (size_t slot = 0; slot < accounts.size(); ++slot) {
+                    if (changed[slot]) {
+                        touched.push_back(accounts[slot]);
+                    }
+                }
+                lsn = logPosting(touched.data(), touched.size(), first, entries.size());
+            }
+            locks.clear();
+            awaitDurable(lsn);
+        });
+    }
+
+    void deposit(const string& accountId, Money amount) {
+        deposit(parseAccountId(accountId), amount);
+    }
+
+    void withdraw(const string& accountId, Money amount) {
+        withdraw(parseAccountId(accountId), amount);
+    }
+
+    void transfer(const string& fromAccountId, const string& toAccountId, Money amount) {
+        transfer(parseAccountId(fromAccountId), parseAccountId(toAccountId), amount);
+    }
+
+    OperationResult tryWithdraw(const string& accountId, Money amount) {
+        AccountHandle handle;
+        return AccountHandle::parse(accountId, handle) ? tryWithdraw(handle, amount)
+                                                       : OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() };
+    }
+
+    OperationResult tryTransfer(const string& fromAccountId, const string& toAccountId, Money amount) {
+        AccountHandle from, to;
+        return AccountHandle::parse(fromAccountId, from) && AccountHandle::parse(toAccountId, to)
+                   ? tryTransfer(from, to, amount)
+                   : OperationResult{ OperationStatus::ACCOUNT_NOT_FOUND, Money() };
+    }
+
+    // Loans
+    // The loan's amortization schedule as agreed at opening (immutable)
+    LoanTable::Schedule loanSchedule(AccountHandle loanId) const {
+        if (loanId.type() != AccountType::LOAN) {
+            throw AccountNotFoundException();
+        }
+        return store.loans.scheduleFor(requireRow(loanId));
+    }
+
+    // Portfolio totals for every active loan, projected months ahead
+    LoanProjection projectLoans(int months) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        return store.loans.project(months);
+    }
+
+    // History queries
+    // Newest-first page of an account's transactions matching the query. Only
+    // the account's history index is searched; the ledger is read just for the
+    // records returned.
+    HistoryPage queryHistory(AccountHandle accountId, const HistoryQuery& query) const {
+        uint32_t row = requireRow(accountId);
+        HistoryPage page;
+        lock_guard<mutex> lock(lockFor(accountId));
+        const vector<HistoryEntry>& entries = store.columnsFor(accountId.type()).history[row];
+        auto range = timeRange(entries, query);
+        size_t position = query.cursor != 0 ? min<uint64_t>(query.cursor, range.second) : range.second;
+        while (position > range.first && page.transactions.size() < query.limit) {
+            const HistoryEntry& entry = entries[--position];
+            if (query.wants(entry.type())) {
+                page.transactions.push_back(ledger.at(entry.index()));
+            }
+        }
+        page.nextCursor = position > range.first ? position : 0;
+        return page;
+    }
+
+    // Number of an account's transactions matching the query's time range and
+    // types (its limit and cursor are ignored)
+    size_t countHistory(AccountHandle accountId, const HistoryQuery& query) const {
+        uint32_t row = requireRow(accountId);
+        lock_guard<mutex> lock(lockFor(accountId));
+        const vector<HistoryEntry>& entries = store.columnsFor(accountId.type()).history[row];
+        auto range = timeRange(entries, query);
+        if (query.typeMask == HistoryQuery::allTypes) {
+            return range.second - range.first;
+        }
+        size_t matches = 0;
+        for (size_t position = range.first; position < range.second; ++position) {
+            matches += query.wants(entries[position].type()) ? 1 : 0;
+        }
+        return matches;
+    }
+
+    // Reporting and display methods
+    void displayAllCustomers() const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        cout << "\n=== All Customers ===" << endl;
+        if (customers.empty()) {
+            cout << "No customers found." << endl;
+            return;
+        }
+
+        for (const auto& customer : customers) {
+            customer->displayCustomerInfo();
+            cout << "------------------------" << endl;
+        }
+    }
+
+    void displayAllAccounts() const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        cout << "\n=== All Accounts ===" << endl;
+        if (store.size() == 0) {
+            cout << "No accounts found." << endl;
+            return;
+        }
+
+        for (uint32_t index = 0; index < store.size(); ++index) {
+            auto account = store.view(store.handleAt(index));
+            lock_guard<mutex> lock(lockFor(account->getHandle()));
+            account->displayAccountInfo();
+            cout << "------------------------" << endl;
+        }
+    }
+
+    void displayCustomerAccounts(const string& customerId) const {
+        auto customer = findCustomer(customerId);
+        if (!customer) {
+            cout << "Customer not found." << endl;
+            return;
+        }
+
+        shared_lock<shared_mutex> directory(directoryMutex);
+        cout << "\n=== Accounts for Customer: " << customer->getFullName() << " ===" << endl;
+        const auto& accountIds = customer->getAccountIds();
+        
+        if (accountIds.empty()) {
+            cout << "No accounts found for this customer." << endl;
+            return;
+        }
+
+        for (AccountHandle accId : accountIds) {
+            auto account = store.view(accId);
+            if (account) {
+                lock_guard<mutex> lock(lockFor(accId));
+                account->displayAccountInfo();
+                cout << "------------------------" << endl;
+            }
+        }
+    }
+
+    // Reads the running aggregates without taking account locks, so a summary
+    // taken while operations are in flight may include one side of a transfer
+    // but not the other
+    BankSummary summary() const {
+        BankSummary result;
+        {
+            shared_lock<shared_mutex> directory(directoryMutex);
+            result.customers = customers.size();
+            result.savingsAccounts = store.savings.rows;
+            result.checkingAccounts = store.checking.rows;
+            result.loanAccounts = store.loans.rows;
+        }
+        const AccountColumns* tables[] = { &store.savings, &store.checking, &store.loans };
+        for (const AccountColumns* table : tables) {
+            result.activeAccounts += table->totals.active.load(memory_order_relaxed);
+        }
+        result.totalDeposits = Money::fromCents(store.savings.totals.balance.load(memory_order_relaxed) +
+                                                store.checking.totals.balance.load(memory_order_relaxed));
+        result.overdrawn = Money::fromCents(store.savings.totals.debit.load(memory_order_relaxed) +
+                                            store.checking.totals.debit.load(memory_order_relaxed));
+        result.loanExposure = Money::fromCents(store.loans.totals.debit.load(memory_order_relaxed));
+        result.transactions = ledger.size();
+        for (size_t type = 0; type < transactionTypeCount; ++type) {
+            result.transactionsByType[type] = ledger.countOf(static_cast<TransactionType>(type));
+        }
+        return result;
+    }
+
+    // Bytes held per customer, account and transaction, by component. Stops
+    // all account operations while it reads the account histories.
+    MemoryUsage memoryUsage() const {
+        // A make_shared block adds its vtable pointer and two reference counts to each Customer
+        const size_t controlBlockBytes = sizeof(void*) + 2 * sizeof(int);
+        MemoryUsage usage;
+        {
+            shared_lock<shared_mutex> directory(directoryMutex);
+            usage.customers = customers.size();
+            size_t accountLists = 0;
+            for (const auto& customer : customers) {
+                accountLists += customer->getAccountIds().capacity() * sizeof(AccountHandle);
+            }
+            usage.customerParts = {
+                { "records", customers.size() * (sizeof(Customer) + controlBlockBytes) },
+                { "directory", customers.capacity() * sizeof(shared_ptr<Customer>) },
+                { "account lists", accountLists },
+                { "text", customerText.textBytes() },
+                { "name interning", customerText.internBytes() },
+                { "lookup indexes", customerIndex.memoryBytes() },
+            };
+        }
+        {
+            auto stripes = lockAllAccounts();
+            usage.accounts = store.size();
+            usage.accountParts = {
+                { "columns", store.columnBytes() },
+                { "directory", store.directoryBytes() },
+                { "history index", store.historyBytes() },
+            };
+        }
+        usage.transactions = ledger.size();
+        usage.transactionParts = {
+            { "records", ledger.recordBytes() },
+            { "descriptions", ledger.descriptionBytes() },
+        };
+        return usage;
+    }
+
+    // Debug check: recomputes every aggregate from the account tables and the
+    // ledger, O(accounts + transactions), and reports any that disagree with the
+    // running values. Stops all account operations while it runs.
+    bool verifyAggregates(ostream& out) const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        bool consistent = true;
+        auto check = [&](const string& name, int64_t recomputed, int64_t maintained) {
+            if (recomputed != maintained) {
+                out << "aggregate mismatch: " << name << " recomputed " << recomputed
+                    << ", maintained " << maintained << '\n';
+                consistent = false;
+            }
+        };
+
+        const AccountColumns* tables[] = { &store.savings, &store.checking, &store.loans };
+        for (const AccountColumns* table : tables) {
+            int64_t balanceSum = 0, debitSum = 0, activeRows = 0;
+            for (uint32_t row = 0; row < table->rows; ++row) {
+                balanceSum += table->balance[row];
+                debitSum += AccountColumns::debitOf(table->balance[row]);
+                activeRows += table->active[row] ? 1 : 0;
+            }
+            string prefix = AccountHandle::prefix(table->type);
+            check(prefix + " balance", balanceSum, table->totals.balance.load(memory_order_relaxed));
+            check(prefix + " debit", debitSum, table->totals.debit.load(memory_order_relaxed));
+            check(prefix + " active", activeRows, table->totals.active.load(memory_order_relaxed));
+        }
+
+        array<int64_t, transactionTypeCount> typeCounts{};
+        ledger.forEach([&](const Transaction& transaction) {
+            typeCounts[static_cast<size_t>(transaction.getType())]++;
+        });
+        for (size_t type = 0; type < transactionTypeCount; ++type) {
+            TransactionType transactionType = static_cast<TransactionType>(type);
+            check(string(Transaction::typeName(transactionType)) + " count", typeCounts[type],
+                  static_cast<int64_t>(ledger.countOf(transactionType)));
+        }
+        return consistent;
+    }
+
+    // Constant time: every figure comes from the running aggregates
+    void generateBankReport() const {
+#ifdef BANK_DEBUG_AGGREGATES
+        verifyAggregates(cerr);
+#endif
+        BankSummary totals = summary();
+        cout << "\n========== BANK REPORT ==========" << endl;
+        cout << "Bank Name: " << bankName << endl;
+        cout << "Total Customers: " << totals.customers << endl;
+        cout << "Total Accounts: " << totals.savingsAccounts + totals.checkingAccounts + totals.loanAccounts << endl;
+        cout << "Total Transactions: " << totals.transactions << endl;
+        cout << "Savings Accounts: " << totals.savingsAccounts << endl;
+        cout << "Checking Accounts: " << totals.checkingAccounts << endl;
+        cout << "Loan Accounts: " << totals.loanAccounts << endl;
+        cout << "Active Accounts: " << totals.activeAccounts << endl;
+        cout << "Total Deposits: $" << totals.totalDeposits << endl;
+        cout << "Loan Exposure: $" << totals.loanExposure << endl;
+        cout << "Overdrawn Balances: $" << totals.overdrawn << endl;
+        cout << "Transactions by Type:";
+        for (size_t type = 0; type < transactionTypeCount; ++type) {
+            cout << " " << Transaction::typeName(static_cast<TransactionType>(type))
+                 << "=" << totals.transactionsByType[type];
+        }
+        cout << endl;
+        cout << "=================================" << endl;
+    }
+
+    // Monthly operations
+    // Interest runs stop the world: every account stripe is taken in order
+    // (the same order transfers use), then the InterestEngine computes all
+    // accounts in parallel, the postings are appended to the ledger at once,
+    // and only then does the engine apply them to the balances.
+    void processMonthlyInterest() {
+        BankMetrics::measure(BankOperation::MONTHLY_INTEREST, [&] {
+            shared_lock<shared_mutex> directory(directoryMutex);
+            auto stripes = lockAllAccounts();
+            uint64_t lsn = 0;
+
+            size_t workers = max(1u, thread::hardware_concurrency());
+            InterestEngine::Month month = InterestEngine::compute(store, workers);
+            const vector<InterestEngine::Posting>& postings = month.postings;
+
+            // Record interest transactions; loan interest is a charge, so it flows to the bank
+            vector<TransactionLedger::Entry> entries;
+            vector<const InterestEngine::Posting*> recorded;
+            entries.reserve(postings.size());
+            recorded.reserve(postings.size());
+            for (const auto& posting : postings) {
+                if (posting.interest == Money()) continue;
+                bool charge = posting.interest < Money();
+                entries.push_back(TransactionLedger::Entry{ charge ? posting.account : AccountHandle::bank(),
+                                                            charge ? AccountHandle::bank() : posting.account,
+                                                            posting.interest.abs(),
+                                                            charge ? TransactionType::INTEREST_CHARGE
+                                                                   : TransactionType::INTEREST_CREDIT,
+                                                            monthlyInterestRef });
+                recorded.push_back(&posting);
+            }
+            TransactionLedger::Index first = ledger.appendBulk(entries);
+            InterestEngine::apply(store, month, workers);
+            vector<AccountHandle> touched;
+            touched.reserve(recorded.size());
+            for (size_t i = 0; i < recorded.size(); ++i) {
+                addHistory(store.columnsFor(recorded[i]->account.type()), recorded[i]->row, first + i);
+                touched.push_back(recorded[i]->account);
+            }
+            lsn = logPosting(touched.data(), touched.size(), first, entries.size());
+
+            if (BankEvents::enabled()) {
+                BankEvents::publishNamed(BankEventType::INTEREST_RUN_STARTED, bankName);
+                for (const auto& posting : postings) {
+                    BankEvents::publish(BankEventType::INTEREST_ACCOUNT_STARTED, posting.account);
+                    if (posting.interest != Money() || posting.account.type() != AccountType::CHECKING) {
+                        BankEvents::publish(BankEventType::INTEREST_APPLIED, posting.account, posting.interest.abs(),
+                                            posting.balance);
+                    }
+                    BankEvents::publish(BankEventType::INTEREST_ACCOUNT_FINISHED, posting.account);
+                }
+            }
+            stripes.clear();
+            directory.unlock();
+            awaitDurable(lsn);
+        });
+    }
+
+    // Event-sourced state
+    // Every balance change is a ledger record, so the ledger alone determines
+    // every balance. An audit replays it (see LedgerReplay) and reports each
+    // account whose stored balance disagrees; a rebuild then makes the stored
+    // balances and loan repayment state those of the ledger.
+    LedgerAudit auditLedger() const {
+        shared_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        return replayLedger();
+    }
+
+    LedgerAudit rebuildFromLedger() {
+        unique_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        LedgerAudit audit = replayLedger();
+        for (const LedgerMismatch& mismatch : audit.mismatches) {
+            uint32_t row = store.rowAt(mismatch.account.index());
+            store.columnsFor(mismatch.account.type()).setBalance(row, mismatch.derived.getCents());
+        }
+        rebuildLoanState();
+        return audit;
+    }
+
+    // Durability
+    // Applies the intact records of an existing log on top of the current state,
+    // which must be the state the log started from (an empty bank, or the
+    // snapshot whose saving restarted the log) or a later one. A crash after a
+    // snapshot is published but before its log restarts leaves a log that
+    // starts earlier; the records the snapshot already holds are skipped.
+    // Replay stops at the first torn or corrupt record, as left by a crash
+    // mid-write. Returns the length of the intact prefix, or 0 when no record
+    // follows the current state and the log should start afresh from it.
+    uint64_t replayWriteAheadLog(const string& filename) {
+        MappedFile file(filename);
+        SnapshotReader reader(file.data(), file.size());
+        auto header = reader.read<WriteAheadLog::LogHeader>();
+        if (memcmp(header.magic, WriteAheadLog::LogHeader::magicText, sizeof(header.magic)) != 0 ||
+            header.version != WriteAheadLog::LogHeader::currentVersion) {
+            throw BankException(filename + " is not a supported write-ahead log");
+        }
+
+        unique_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        // State reached by the log so far, while it is behind the current state
+        uint64_t loggedCustomers = header.baseCustomers;
+        uint64_t loggedAccounts = header.baseAccounts;
+        uint64_t loggedTransactions = header.baseTransactions;
+        auto caughtUp = [&] {
+            return loggedCustomers == customers.size() && loggedAccounts == store.size() &&
+                   loggedTransactions == ledger.size();
+        };
+        bool behind = !caughtUp();
+        if (loggedCustomers > customers.size() || loggedAccounts > store.size() ||
+            loggedTransactions > ledger.size()) {
+            throw BankException(filename + " does not start from the current state; load its snapshot first");
+        }
+
+        // Logged description references are this bank's own interned references
+        vector<uint32_t> descriptionRefs(ledger.stringCount());
+        iota(descriptionRefs.begin(), descriptionRefs.end(), 0);
+
+        uint64_t validLength = sizeof(header);
+        uint64_t records = 0;
+        uint64_t skipped = 0;
+        uint64_t lastTransactionId = 0;
+        while (reader.remaining() >= WriteAheadLog::recordHeaderSize) {
+            uint32_t length = reader.read<uint32_t>();
+            uint32_t checksum = reader.read<uint32_t>();
+            uint8_t kind = reader.read<uint8_t>();
+            if (length > reader.remaining()) {
+                break;
+            }
+            const char* payload = reader.readArray(length, 1);
+            if (crc32(payload, length, crc32(reinterpret_cast<const char*>(&kind), 1)) != checksum) {
+                break;
+            }
+            if (behind && !caughtUp()) {
+                // Records are whole operations, so each is either in the current state or after it
+                uint64_t customerCount = loggedCustomers, accountCount = loggedAccounts;
+                uint64_t transactionCount = loggedTransactions;
+                countLogRecord(static_cast<WriteAheadLog::RecordKind>(kind), SnapshotReader(payload, length),
+                               customerCount, accountCount, transactionCount);
+                if (customerCount <= customers.size() && accountCount <= store.size() &&
+                    transactionCount <= ledger.size()) {
+                    loggedCustomers = customerCount;
+                    loggedAccounts = accountCount;
+                    loggedTransactions = transactionCount;
+                    validLength += WriteAheadLog::recordHeaderSize + length;
+                    skipped++;
+                    continue;
+                }
+                throw BankException(filename + " does not continue from the current state");
+            }
+            SnapshotReader record(payload, length);
+            applyLogRecord(static_cast<WriteAheadLog::RecordKind>(kind), record, descriptionRefs, lastTransactionId);
+            validLength += WriteAheadLog::recordHeaderSize + length;
+            records++;
+        }
+        TransactionIdAllocator::reseed(lastTransactionId);
+        rebuildLoanState();
+
+        cout << "Recovered " << records << " log records from " << filename;
+        if (skipped > 0) {
+            cout << " (skipped " << skipped << " already in the current state)";
+        }
+        cout << endl;
+        return behind && records == 0 ? 0 : validLength;
+    }
+
+    // Recovers from an existing log (see replayWriteAheadLog), then logs every
+    // committed change to it. Must be called before the bank is shared between
+    // threads; commitDelay is how long a flush waits for more changes to join it.
+    void openWriteAheadLog(const string& filename, chrono::microseconds commitDelay) {
+        if (wal) {
+            throw BankException("A write-ahead log is already open");
+        }
+        uint64_t validLength = 0;
+        struct stat info;
+        if (stat(filename.c_str(), &info) == 0 &&
+            static_cast<size_t>(info.st_size) >= sizeof(WriteAheadLog::LogHeader)) {
+            validLength = replayWriteAheadLog(filename);
+        }
+        shared_lock<shared_mutex> directory(directoryMutex);
+        wal = make_unique<WriteAheadLog>(filename, commitDelay, validLength, customers.size(), store.size(),
+                                         ledger.size());
+    }
+
+    // Save and load functionality
+    // Binary snapshot of customers, accounts with their type-specific fields,
+    // the ledger and the transaction ID counter. Account operations are paused
+    // while it is written; the file is written beside the target, synced and
+    // renamed into place, so an existing snapshot is only replaced by a whole one.
+    // An attached write-ahead log is then restarted from the snapshot.
+    void saveSnapshot(const string& filename) const {
+        string temporary = filename + ".tmp";
+        SnapshotHeader header{};
+        {
+            shared_lock<shared_mutex> directory(directoryMutex);
+            auto stripes = lockAllAccounts();
+            SnapshotWriter writer(temporary);
+
+            memcpy(header.magic, SnapshotHeader::magicText, sizeof(header.magic));
+            header.version = SnapshotHeader::currentVersion;
+            header.headerSize = sizeof(SnapshotHeader);
+            header.customerCount = customers.size();
+            header.accountCount = store.size();
+            header.transactionCount = ledger.size();
+            header.stringCount = ledger.stringCount();
+            header.lastTransactionId = TransactionIdAllocator::highWaterMark();
+            writer.writeValue(header);
+
+            writer.writeString(bankName);
+            for (uint32_t ref = 0; ref < header.stringCount; ++ref) {
+                writer.writeString(ledger.resolve(ref));
+            }
+            for (const auto& customer : customers) {
+                writer.writeString(customer->getFirstName());
+                writer.writeString(customer->getLastName());
+                writer.writeString(customer->getEmail());
+                writer.writeString(customer->getPhone());
+                writer.writeString(customer->getAddress());
+            }
+            writer.alignTo(8);
+            for (uint32_t index = 0; index < header.accountCount; ++index) {
+                writer.writeValue(store.recordAt(index));
+            }
+            ledger.forEach([&](const Transaction& transaction) {
+                writer.writeValue(transaction.toRecord());
+            });
+
+            header.fileSize = writer.offset();
+            writer.patch(0, &header, sizeof(header));
+            writer.commit();
+            if (rename(temporary.c_str(), filename.c_str()) != 0) {
+                throw BankException("Cannot replace " + filename);
+            }
+
+            // Everything logged so far is in the snapshot, so the log restarts from it
+            if (wal) {
+                wal->reset(header.customerCount, header.accountCount, header.transactionCount);
+            }
+        }
+        cout << "Snapshot saved to " << filename << " (" << header.accountCount << " accounts, "
+             << header.transactionCount << " transactions)" << endl;
+    }
+
+    // Restores a snapshot into this bank, which must still be empty. The file
+    // is memory-mapped and its fixed-size records are copied straight into the
+    // account tables and ledger; histories are rebuilt in one pass over the
+    // ledger. If the file turns out to be malformed part way through, the
+    // bank is left partially loaded and should be discarded.
+    void loadSnapshot(const string& filename) {
+        MappedFile file(filename);
+        SnapshotReader reader(file.data(), file.size());
+        SnapshotHeader header = reader.read<SnapshotHeader>();
+        if (memcmp(header.magic, SnapshotHeader::magicText, sizeof(header.magic)) != 0 ||
+            header.version != SnapshotHeader::currentVersion || header.headerSize != sizeof(SnapshotHeader)) {
+            throw BankException(filename + " is not a supported bank snapshot");
+        }
+        if (header.fileSize != file.size()) {
+            throw BankException("Snapshot file is truncated");
+        }
+        // Every string costs at least its length prefix, which bounds the counts
+        if (header.stringCount > reader.remaining() / sizeof(uint32_t) ||
+            header.customerCount > reader.remaining() / (5 * sizeof(uint32_t))) {
+            throw BankException("Snapshot header is corrupt");
+        }
+
+        unique_lock<shared_mutex> directory(directoryMutex);
+        auto stripes = lockAllAccounts();
+        if (!customers.empty() || store.size() != 0 || !ledger.empty()) {
+            throw BankException("Snapshots can only be loaded into an empty bank");
+        }
+        if (wal) {
+            throw BankException("Snapshots must be loaded before the write-ahead log is opened");
+        }
+
+        string name(reader.readString());
+        vector<uint32_t> descriptionRefs(header.stringCount);
+        for (auto& ref : descriptionRefs) {
+            ref = ledger.intern(string(reader.readString()));
+        }
+
+        customers.reserve(header.customerCount);
+        for (uint64_t i = 0; i < header.customerCount; ++i) {
+            string_view fields[5];
+            for (auto& field : fields) {
+                field = reader.readString();
+            }
+            customers.push_back(make_shared<Customer>(CustomerHandle{ static_cast<uint32_t>(i) }, customerText,
+                                                      fields[0], fields[1], fields[2], fields[3], fields[4]));
+        }
+        customerIndex.addAll();
+
+        reader.alignTo(8);
+        const char* accountRecords = reader.readArray(header.accountCount, sizeof(AccountRecord));
+        for (uint64_t i = 0; i < header.accountCount; ++i) {
+            AccountRecord record;
+            memcpy(&record, accountRecords + i * sizeof(record), sizeof(record));
+            if (record.owner >= customers.size()) {
+                throw BankException("Snapshot account has an unknown owner");
+            }
+            customers[record.owner]->addAccount(store.restore(record));
+        }
+        store.publish();
+
+        const char* transactionRecords = reader.readArray(header.transactionCount, sizeof(TransactionRecord));
+        ledger.restore(transactionRecords, header.transactionCount, descriptionRefs);
+
+        TransactionIdAllocator::reseed(max(header.lastTransactionId, indexHistory(0)));
+        rebuildLoanState();
+        bankName = name;
+
+        cout << "Snapshot loaded from " << filename << " (" << customers.size() << " customers, "
+             << store.size() << " accounts, " << ledger.size() << " transactions)" << endl;
+    }
+
+    // Human-readable export; not a complete record of the bank (see saveSnapshot)
+    void saveToFile(const string& filename) const {
+        ofstream file(filename);
+        if (!file.is_open()) {
+            cout << "Error opening file for writing." << endl;
+            return;
+        }
+
+        shared_lock<shared_mutex> directory(directoryMutex);
+        file << "=== BANK DATA EXPORT ===" << endl;
+        file << "Bank Name: " << bankName << endl;
+        file << "Export Date: " << formatEpochSeconds(currentEpochSeconds(), "%Y-%m-%d %H:%M:%S") << endl;
+        
+        file << "\n=== CUSTOMERS ===" << endl;
+        for (const auto& customer : customers) {
+            file << customer->getCustomerId() << "|" 
+                 << customer->getFirstName() << "|"
+                 << customer->getLastName() << "|"
+                 << customer->getEmail() << "|"
+                 << customer->getPhone() << "|"
+                 << customer->getAddress() << endl;
+        }
+
+        file << "\n=== ACCOUNTS ===" << endl;
+        for (uint32_t index = 0; index < store.size(); ++index) {
+            auto account = store.view(store.handleAt(index));
+            file << account->getAccountId() << "|"
+                 << account->getCustomerId() << "|"
+                 << account->getAccountTypeString() << "|"
+                 << balanceOf(*account) << "|"
+                 << account->getCreationDate() << "|"
+                 << (account->getIsActive() ? "ACTIVE" : "CLOSED") << endl;
+        }
+
+        file.close();
+        cout << "Bank data saved to " << filename << endl;
+    }
+};
+
+// BankPipeline class - asynchronous front door to a Bank. Callers submit
+// requests and get a future or a callback. Requests are spread over shards by
+// the account they debit, credit or query; each shard has a bounded queue fed
+// by any number of producers and drained by one worker thread, which takes up
+// to maxBatch requests at a time and executes them as one
+// Bank::executeRequests group, so the batch shares its lock acquisitions,
+// ledger append, log record and log sync. One account's requests therefore
+// run in submission order and tend to share batches. A full queue makes
+// submit wait (and trySubmit fail) rather than let latency grow without bound.
+class BankPipeline {
+public:
+    // Called on a worker thread once the request has run. error is set, and
+    // the result a refusal, only if the request could not be executed at all
+    // (the ledger was full, say). A request that took effect gets its result
+    // even if its batch's log write then failed; that failure reaches the
+    // requests after it. Callbacks must not wait on the pipeline.
+    using Callback = function<void(const OperationResult& result, exception_ptr error)>;
+
+    struct Config {
+        size_t workers = 2;
+        size_t queueCapacity = 4096; // requests per worker
+        size_t maxBatch = 256;
+    };
+
+private:
+    struct Pending {
+        BankRequest request;
+        Callback callback;
+    };
+
+    struct Shard {
+        mutex guard;
+        condition_variable notEmpty;
+        condition_variable notFull;
+        vector<Pending> queue; // ring buffer of queueCapacity entries
+        size_t head = 0;
+        size_t count = 0;
+        bool stopping = false;
+        thread worker;
+    };
+
+    Bank& bank;
+    Config config;
+    vector<unique_ptr<Shard>> shards;
+
+    bool enqueue(const BankRequest& request, Callback&& callback, bool wait) {
+        Shard& shard = *shards[request.account.index() % shards.size()];
+        unique_lock<mutex> lock(shard.guard);
+        if (shard.count == shard.queue.size()) {
+            if (!wait) {
+                return false;
+            }
+            shard.notFull.wait(lock, [&] { return shard.count < shard.queue.size() || shard.stopping; });
+        }
+        if (shard.stopping) {
+            throw BankException("Request pipeline is shut down");
+        }
+        shard.queue[(shard.head + shard.count) % shard.queue.size()] = Pending{ request, move(callback) };
+        bool wasEmpty = shard.count++ == 0;
+        lock.unlock();
+        if (wasEmpty) {
+            shard.notEmpty.notify_one();
+        }
+        return true;
+    }
+
+    // Runs until the pipeline stops and the shard's queue is empty
+    void work(Shard& shard) {
+        vector<Pending> batch;
+        vector<BankRequest> requests;
+        vector<OperationResult> results;
+        batch.reserve(config.maxBatch);
+        requests.reserve(config.maxBatch);
+        for (;;) {
+            {
+                unique_lock<mutex> lock(shard.guard);
+                shard.notEmpty.wait(lock, [&] { return shard.count != 0 || shard.stopping; });
+                if (shard.count == 0) {
+                    return;
+                }
+                size_t taken = min(shard.count, config.maxBatch);
+                for (size_t i = 0; i < taken; ++i) {
+                    batch.push_back(move(shard.queue[shard.head]));
+                    shard.head = (shard.head + 1) % shard.queue.size();
+                }
+                shard.count -= taken;
+            }
+            shard.notFull.notify_all();
+
+            for (const Pending& pending : batch) {
+                requests.push_back(pending.request);
+            }
+            // Requests that took effect get their results even if the batch
+            // then failed, so a client does not retry them; the rest get the error
+            exception_ptr error;
+            try {
+                bank.executeRequests(requests, results);
+            }
+            catch (...) {
+                error = current_exception();
+            }
+            const OperationResult notRun{ OperationStatus::REFUSED, Money() };
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (i < results.size()) {
+                    batch[i].callback(results[i], nullptr);
+                } else {
+                    batch[i].callback(notRun, error);
+                }
+            }
+            batch.clear();
+            requests.clear();
+        }
+    }
+
+public:
+    BankPipeline(Bank& target, const Config& cfg) : bank(target), config(cfg) {
+        config.workers = max<size_t>(1, config.workers);
+        config.queueCapacity = max<size_t>(1, config.queueCapacity);
+        config.maxBatch = max<size_t>(1, config.maxBatch);
+        for (size_t i = 0; i < config.workers; ++i) {
+            shards.push_back(make_unique<Shard>());
+            shards.back()->queue.resize(config.queueCapacity);
+        }
+        for (auto& shard : shards) {
+            shard->worker = thread(&BankPipeline::work, this, ref(*shard));
+        }
+    }
+
+    // Runs every request already queued, then stops the workers
+    ~BankPipeline() {
+        for (auto& shard : shards) {
+            {
+                lock_guard<mutex> lock(shard->guard);
+                shard->stopping = true;
+            }
+            shard->notEmpty.notify_all();
+            shard->notFull.notify_all();
+        }
+        for (auto& shard : shards) {
+            shard->worker.join();
+        }
+    }
+
+    BankPipeline(const BankPipeline&) = delete;
+    BankPipeline& operator=(const BankPipeline&) = delete;
+
+    // Waits while the request's queue is full
+    void submit(const BankRequest& request, Callback callback) {
+        enqueue(request, move(callback), true);
+    }
+
+    // Returns false at once, queuing nothing, if the request's queue is full
+    bool trySubmit(const BankRequest& request, Callback callback) {
+        return enqueue(request, move(callback), false);
+    }
+
+    future<OperationResult> submit(const BankRequest& request) {
+        auto done = make_shared<promise<OperationResult>>();
+        future<OperationResult> result = done->get_future();
+        submit(request, [done](const OperationResult& outcome, exception_ptr error) {
+            if (error) {
+                done->set_exception(error);
+            } else {
+                done->set_value(outcome);
+            }
+        });
+        return result;
+    }
+};
+
+// Utility functions for the menu system
+void displayMainMenu() {
+    cout << "\n========== BANK MANAGEMENT SYSTEM ==========" << endl;
+    cout << "1.  Create Customer" << endl;
+    cout << "2.  Create Savings Account" << endl;
+    cout << "3.  Create Checking Account" << endl;
+    cout << "4.  Create Loan Account" << endl;
+    cout << "5.  Deposit Money" << endl;
+    cout << "6.  Withdraw Money" << endl;
+    cout << "7.  Transfer Money" << endl;
+    cout << "8.  View Customer Information" << endl;
+    cout << "9.  View Account Information" << endl;
+    cout << "10. View Customer Accounts" << endl;
+    cout << "11. View Transaction History" << endl;
+    cout << "12. View All Customers" << endl;
+    cout << "13. View All Accounts" << endl;
+    cout << "14. Process Monthly Interest" << endl;
+    cout << "15. Generate Bank Report" << endl;
+    cout << "16. Save Data to File" << endl;
+    cout << "0.  Exit" << endl;
+    cout << "=============================================" << endl;
+    cout << "Choose an option: ";
+}
+
+// BatchProcessor class - drives the Bank from a scripted command stream
+// One command per line, whitespace separated; blank lines and '#' comments are skipped:
+//   CREATE_CUSTOMER <first> <last> <email> <phone> <address...>
+//   OPEN_SAVINGS <customerId> <amount>
+//   OPEN_CHECKING <customerId> <amount>
+//   OPEN_LOAN <customerId> <amount> <termMonths>
+//   DEPOSIT <accountId> <amount>
+//   WITHDRAW <accountId> <amount>
+//   TRANSFER <fromAccountId> <toAccountId> <amount>
+//   TRANSFER_BATCH <filename>   (one "<fromAccountId> <toAccountId> <amount>" per line, all or nothing)
+//   ACCRUE
+//   REPORT
+//   VERIFY
+//   AUDIT                  (replay the ledger and compare every balance)
+//   REBUILD                (reset every balance to the ledger's)
+//   METRICS [JSON]
+//   MEMORY                 (bytes per customer, account and transaction by component)
+//   SAVE <filename>
+//   FIND_CUSTOMER EMAIL <email> | PHONE <phone> | NAME <lastNamePrefix> [limit]
+//   SCHEDULE <loanId> [limit]
+//   PROJECT_LOANS <months>
+//   HISTORY <accountId> [limit=<n>] [types=<TYPE,...>] [from=<epoch>] [until=<epoch>] [cursor=<n>]
+//   SNAPSHOT <filename>
+//   LOAD <filename>        (only into an empty bank)
+class BatchProcessor {
+private:
+    Bank& bank;
+    ostream& errorStream;
+    size_t lineNumber;
+    size_t succeeded;
+    size_t failed;
+
+    // Splits off the next whitespace separated token, advancing pos past it
+    static string_view nextToken(string_view line, size_t& pos) {
+        while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos]))) pos++;
+        size_t start = pos;
+        while (pos < line.size() && !isspace(static_cast<unsigned char>(line[pos]))) pos++;
+        return line.substr(start, pos - start);
+    }
+
+    static string_view restOfLine(string_view line, size_t pos) {
+        while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos]))) pos++;
+        size_t end = line.size();
+        while (end > pos && isspace(static_cast<unsigned char>(line[end - 1]))) end--;
+        return line.substr(pos, end - pos);
+    }
+
+    static string requireToken(string_view line, size_t& pos, const char* what) {
+        string_view token = nextToken(line, pos);
+        if (token.empty()) {
+            throw invalid_argument(string("missing ") + what);
+        }
+        return string(token);
+    }
+
+    static Money requireAmount(string_view line, size_t& pos) {
+        string token = requireToken(line, pos, "amount");
+        Money value;
+        if (!Money::parse(token, value)) {
+            throw invalid_argument("malformed amount '" + token + "'");
+        }
+        return value;
+    }
+
+    static int requireInt(string_view line, size_t& pos, const char* what) {
+        string token = requireToken(line, pos, what);
+        char* end = nullptr;
+        errno = 0;
+        long value = strtol(token.c_str(), &end, 10);
+        if (end == token.c_str() || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+            throw invalid_argument(string("malformed ") + what + " '" + token + "'");
+        }
+        return static_cast<int>(value);
+    }
+
+    // Rejects text that is not a whole number in [minimum, INT64_MAX]
+    static int64_t parseInteger(const string& text, const char* what, int64_t minimum = INT64_MIN) {
+        char* end = nullptr;
+        errno = 0;
+        long long value = strtoll(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || errno == ERANGE || value < minimum) {
+            throw invalid_argument(string("malformed ") + what + " '" + text + "'");
+        }
+        return value;
+    }
+
+    static uint32_t parseTypeMask(const string& list) {
+        uint32_t mask = 0;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t end = min(list.find(',', start), list.size());
+            string name = list.substr(start, end - start);
+            size_t type = 0;
+            while (type < transactionTypeCount && name != Transaction::typeName(static_cast<TransactionType>(type))) {
+                type++;
+            }
+            if (type == transactionTypeCount) {
+                throw invalid_argument("unknown transaction type '" + name + "'");
+            }
+            mask |= 1u << type;
+            start = end + 1;
+        }
+        return mask;
+    }
+
+    void transferBatch(const string& filename) {
+        ifstream in(filename);
+        if (!in) {
+            throw BankException("Cannot open " + filename);
+        }
+        vector<TransferInstruction> transfers;
+        string text;
+        for (size_t number = 1; getline(in, text); ++number) {
+            string_view entry(text);
+            entry = entry.substr(0, entry.find('#'));
+            size_t pos = 0;
+            if (restOfLine(entry, pos).empty()) {
+                continue;
+            }
+            try {
+                TransferInstruction transfer;
+                string fromAccountId = requireToken(entry, pos, "source account ID");
+                string toAccountId = requireToken(entry, pos, "destination account ID");
+                if (!AccountHandle::parse(fromAccountId, transfer.from) ||
+                    !AccountHandle::parse(toAccountId, transfer.to)) {
+                    throw AccountNotFoundException();
+                }
+                transfer.amount = requireAmount(entry, pos);
+                transfers.push_back(transfer);
+            }
+            catch (const exception& e) {
+                throw invalid_argument(filename + ":" + to_string(number) + ": " + e.what());
+            }
+        }
+        bank.transferBatch(transfers);
+        BankEvents::flush();
+        cout << "Applied " << transfers.size() << " transfers from " << filename << endl;
+    }
+
+    void findCustomers(string_view line, size_t& pos) {
+        string field = requireToken(line, pos, "lookup field");
+        string key = requireToken(line, pos, "lookup key");
+        vector<shared_ptr<Customer>> found;
+        if (field == "EMAIL") {
+            found = bank.findCustomersByEmail(key);
+        } else if (field == "PHONE") {
+            found = bank.findCustomersByPhone(key);
+        } else if (field == "NAME") {
+            string_view limit = nextToken(line, pos);
+            found = bank.findCustomersByLastName(key, limit.empty() ? 50
+                : static_cast<size_t>(parseInteger(string(limit), "limit", 0)));
+        } else {
+            throw invalid_argument("unknown lookup field '" + field + "'");
+        }
+
+        BankEvents::flush();
+        cout << "=== " << found.size() << " customer(s) matching " << field << " " << key << " ===" << endl;
+        for (const auto& customer : found) {
+            cout << customer->getCustomerId() << " | " << customer->getFullName() << " | "
+                 << customer->getEmail() << " | " << customer->getPhone() << endl;
+        }
+    }
+
+    void printSchedule(string_view line, size_t& pos) {
+        string loanId = requireToken(line, pos, "loan account ID");
+        string_view limitText = nextToken(line, pos);
+        size_t limit = limitText.empty() ? SIZE_MAX
+                                         : static_cast<size_t>(parseInteger(string(limitText), "limit", 0));
+        AccountHandle handle;
+        if (!AccountHandle::parse(loanId, handle)) {
+            throw AccountNotFoundException();
+        }
+        LoanTable::Schedule schedule = bank.loanSchedule(handle);
+        auto loan = static_pointer_cast<LoanAccount>(bank.findAccount(handle));
+
+        BankEvents::flush();
+        cout << "=== Amortization Schedule for " << loanId << ": " << schedule->size() << " installments of $"
+             << loan->getMonthlyPayment() << " ===" << endl;
+        for (size_t month = 0; month < schedule->size() && month < limit; ++month) {
+            const Amortization::Installment& installment = (*schedule)[month];
+            cout << "Month " << month + 1 << " | Payment: $" << Money::fromCents(installment.payment)
+                 << " | Interest: $" << Money::fromCents(installment.interest)
+                 << " | Principal: $" << Money::fromCents(installment.principal)
+                 << " | Balance: $" << Money::fromCents(installment.balance) << endl;
+        }
+        cout << "Months Charged: " << loan->getMonthsCharged() << " | Interest Due: $" << loan->getInterestDue()
+             << " | Scheduled Principal: $" << loan->getScheduledBalance()
+             << " | Outstanding: $" << bank.balanceOf(*loan).abs() << endl;
+    }
+
+    void printHistory(string_view line, size_t& pos) {
+        AccountHandle accountId;
+        string accountText = requireToken(line, pos, "account ID");
+        if (!AccountHandle::parse(accountText, accountId)) {
+            throw AccountNotFoundException();
+        }
+        HistoryQuery query;
+        for (string_view option = nextToken(line, pos); !option.empty(); option = nextToken(line, pos)) {
+            size_t equals = option.find('=');
+            string key(option.substr(0, equals));
+            string value(equals == string_view::npos ? string_view() : option.substr(equals + 1));
+            if (key == "limit") query.limit = static_cast<size_t>(parseInteger(value, "limit", 0));
+            else if (key == "types") query.typeMask = parseTypeMask(value);
+            else if (key == "from") query.from = parseInteger(value, "time");
+            else if (key == "until") query.until = parseInteger(value, "time");
+            else if (key == "cursor") query.cursor = static_cast<uint64_t>(parseInteger(value, "cursor", 0));
+            else throw invalid_argument("unknown HISTORY option '" + string(option) + "'");
+        }
+
+        BankEvents::flush();
+        HistoryPage page = bank.queryHistory(accountId, query);
+        cout << "=== History for " << accountText << ": " << page.transactions.size() << " of "
+             << bank.countHistory(accountId, query) << " matching ===" << endl;
+        for (const Transaction& transaction : page.transactions) {
+            transaction.display(bank.getLedger());
+        }
+        if (page.nextCursor != 0) {
+            cout << "next cursor=" << page.nextCursor << endl;
+        }
+    }
+
+    static void printAudit(const LedgerAudit& audit) {
+        cout << "=== Ledger Audit: " << audit.records << " records, " << audit.accounts << " accounts, "
+             << audit.mismatches.size() << " mismatched ===" << endl;
+        for (const LedgerMismatch& mismatch : audit.mismatches) {
+            cout << mismatch.account.toString() << " | Stored: $" << mismatch.stored
+                 << " | Ledger: $" << mismatch.derived << endl;
+        }
+    }
+
+    static void printMemoryUsage(const MemoryUsage& usage) {
+        auto printGroup = [](const char* title, const char* unit, size_t count,
+                             const vector<MemoryComponent>& parts) {
+            size_t total = MemoryUsage::total(parts);
+            cout << title << ": " << count << ", " << total << " bytes";
+            if (count != 0) {
+                cout << " (" << fixed << setprecision(1) << double(total) / count << " per " << unit << ")";
+            }
+            cout << endl;
+            for (const MemoryComponent& part : parts) {
+                cout << "  " << left << setw(16) << part.name << right << setw(14) << part.bytes;
+                if (count != 0) {
+                    cout << setw(12) << fixed << setprecision(1) << double(part.bytes) / count;
+                }
+                cout << endl;
+            }
+        };
+        cout << "=== Memory Usage ===" << endl;
+        printGroup("Customers", "customer", usage.customers, usage.customerParts);
+        printGroup("Accounts", "account", usage.accounts, usage.accountParts);
+        printGroup("Transactions", "transaction", usage.transactions, usage.transactionParts);
+        cout << "Total: " << usage.total() << " bytes" << endl;
+    }
+
+    void dispatch(string_view line) {
+        size_t pos = 0;
+        string_view command = nextToken(line, pos);
+
+        if (command == "CREATE_CUSTOMER") {
+            string firstName = requireToken(line, pos, "first name");
+            string lastName = requireToken(line, pos, "last name");
+            string email = requireToken(line, pos, "email");
+            string phone = requireToken(line, pos, "phone");
+            string address(restOfLine(line, pos));
+            bank.createCustomer(firstName, lastName, email, phone, address);
+        } else if (command == "OPEN_SAVINGS") {
+            string customerId = requireToken(line, pos, "customer ID");
+            bank.createSavingsAccount(customerId, requireAmount(line, pos));
+        } else if (command == "OPEN_CHECKING") {
+            string customerId = requireToken(line, pos, "customer ID");
+            bank.createCheckingAccount(customerId, requireAmount(line, pos));
+        } else if (command == "OPEN_LOAN") {
+            string customerId = requireToken(line, pos, "customer ID");
+            Money amount = requireAmount(line, pos);
+            bank.createLoanAccount(customerId, amount, requireInt(line, pos, "term"));
+        } else if (command == "DEPOSIT") {
+            string accountId = requireToken(line, pos, "account ID");
+            bank.deposit(accountId, requireAmount(line, pos));
+        } else if (command == "WITHDRAW") {
+            string accountId = requireToken(line, pos, "account ID");
+            bank.withdraw(accountId, requireAmount(line, pos));
+        } else if (command == "TRANSFER") {
+            string fromAccountId = requireToken(line, pos, "source account ID");
+            string toAccountId = requireToken(line, pos, "destination account ID");
+            bank.transfer(fromAccountId, toAccountId, requireAmount(line, pos));
+        } else if (command == "TRANSFER_BATCH") {
+            transferBatch(requireToken(line, pos, "filename"));
+        } else if (command == "ACCRUE") {
+            bank.processMonthlyInterest();
+        } else if (command == "REPORT") {
+            BankEvents::flush();
+            bank.generateBankReport();
+        } else if (command == "VERIFY") {
+            if (!bank.verifyAggregates(errorStream)) {
+                throw BankException("Aggregates do not match the accounts and ledger");
+            }
+        } else if (command == "AUDIT") {
+            LedgerAudit audit = bank.auditLedger();
+            BankEvents::flush();
+            printAudit(audit);
+            if (!audit.consistent()) {
+                throw BankException("Balances do not match the ledger");
+            }
+        } else if (command == "REBUILD") {
+            LedgerAudit audit = bank.rebuildFromLedger();
+            BankEvents::flush();
+            printAudit(audit);
+            cout << "Rebuilt " << audit.accounts << " balances from the ledger" << endl;
+        } else if (command == "METRICS") {
+            BankEvents::flush();
+            BankMetrics::dump(cout, nextToken(line, pos) == "JSON");
+        } else if (command == "MEMORY") {
+            MemoryUsage usage = bank.memoryUsage();
+            BankEvents::flush();
+            printMemoryUsage(usage);
+        } else if (command == "SAVE") {
+            BankEvents::flush();
+            bank.saveToFile(requireToken(line, pos, "filename"));
+        } else if (command == "FIND_CUSTOMER") {
+            findCustomers(line, pos);
+        } else if (command == "SCHEDULE") {
+            printSchedule(line, pos);
+        } else if (command == "PROJECT_LOANS") {
+            int months = requireInt(line, pos, "months");
+            LoanProjection projection = bank.projectLoans(months);
+            BankEvents::flush();
+            cout << "=== Loan Portfolio Projection (" << months << " months) ===" << endl;
+            cout << "Loans Outstanding: " << projection.loans << endl;
+            cout << "Outstanding Debt: $" << projection.outstanding << endl;
+            cout << "Scheduled Monthly Installments: $" << projection.scheduledInstallments << endl;
+            cout << "Required Monthly Installments: $" << projection.requiredInstallments << endl;
+            cout << "Projected Debt: $" << projection.projectedOutstanding << endl;
+        } else if (command == "HISTORY") {
+            printHistory(line, pos);
+        } else if (command == "SNAPSHOT") {
+            BankEvents::flush();
+            bank.saveSnapshot(requireToken(line, pos, "filename"));
+        } else if (command == "LOAD") {
+            bank.loadSnapshot(requireToken(line, pos, "filename"));
+        } else {
+            throw invalid_argument("unknown command '" + string(command) + "'");
+        }
+    }
+
+public:
+    BatchProcessor(Bank& b, ostream& errors = cerr)
+        : bank(b), errorStream(errors), lineNumber(0), succeeded(0), failed(0) {}
+
+    // Executes a single command line, reporting (not propagating) any failure
+    bool executeLine(string_view line) {
+        lineNumber++;
+        size_t pos = 0;
+        string_view first = nextToken(line, pos);
+        if (first.empty() || first[0] == '#') {
+            return true;
+        }
+
+        try {
+            dispatch(line);
+            succeeded++;
+            return true;
+        }
+        catch (const BankException& e) {
+            errorStream << "line " << lineNumber << ": Bank Error: " << e.what() << '\n';
+        }
+        catch (const exception& e) {
+            errorStream << "line " << lineNumber << ": Parse Error: " << e.what() << '\n';
+        }
+        failed++;
+        return false;
+    }
+
+    // Runs every command in the stream; returns the number of failed lines
+    size_t run(istream& in) {
+        string line;
+        line.reserve(256);
+        while (getline(in, line)) {
+            executeLine(line);
+        }
+        return failed;
+    }
+
+    size_t getSucceeded() const { return succeeded; }
+    size_t getFailed() const { return failed; }
+};
+
+// Runs a batch script from a file, or from stdin when the path is "-"
+int runBatch(Bank& bank, const string& path) {
+    ios::sync_with_stdio(false);
+    BatchProcessor processor(bank);
+
+    // Unless events were silenced or redirected, batch chatter goes through a buffer
+    // instead of being written to the console one message at a time
+    BufferedTextEventSink bufferedSink(cout);
+    if (BankEvents::getSink() == &defaultConsoleSink) {
+        BankEvents::setSink(&bufferedSink);
+    }
+
+    if (path == "-") {
+        processor.run(cin);
+    } else {
+        vector<char> buffer(1 << 16);
+        ifstream file;
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(path);
+        if (!file.is_open()) {
+            cerr << "Error opening batch file: " << path << endl;
+            return 1;
+        }
+        processor.run(file);
+    }
+
+    if (BankEvents::getSink() == &bufferedSink) {
+        BankEvents::setSink(&defaultConsoleSink);
+    }
+    cout.flush();
+    cerr << "Batch complete: " << processor.getSucceeded() << " succeeded, "
+         << processor.getFailed() << " failed" << endl;
+    return processor.getFailed() == 0 ? 0 : 1;
+}
+
+// Benchmark configuration - sizes of the synthetic bank and the op loops
+struct BenchmarkConfig {
+    size_t customers = 10000;
+    size_t accountsPerCustomer = 2;
+    size_t operations = 1000000;
+    size_t interestRuns = 3;
+    size_t reportRuns = 10;
+    size_t transferBatchSize = 1000;
+    uint64_t seed = 42;
+};
+
+// BankBenchmark class - measures the cost of the Bank hot paths
+class BankBenchmark {
+private:
+    // Swallows console output so the benchmark measures banking logic, not the terminal
+    class NullBuffer : public streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+        streamsize xsputn(const char*, streamsize n) override { return n; }
+    };
+
+    // Latency samples for one operation, capped so long runs keep bounded memory
+    class LatencyRecorder {
+    private:
+        static constexpr size_t maxSamples = 1 << 20;
+        vector<uint64_t> samples;
+        size_t stride;
+        size_t seen;
+
+    public:
+        explicit LatencyRecorder(size_t expectedOps)
+            : stride(max<size_t>(1, expectedOps / maxSamples)), seen(0) {
+            samples.reserve(min(expectedOps, maxSamples));
+        }
+
+        void record(uint64_t nanos) {
+            if (seen++ % stride == 0 && samples.size() < maxSamples) {
+                samples.push_back(nanos);
+            }
+        }
+
+        uint64_t percentile(double p) {
+            if (samples.empty()) return 0;
+            size_t rank = static_cast<size_t>(p * (samples.size() - 1));
+            nth_element(samples.begin(), samples.begin() + rank, samples.end());
+            return samples[rank];
+        }
+    };
+
+    BenchmarkConfig config;
+    Bank bank;
+    vector<AccountHandle> accountIds;
+    mt19937_64 rng;
+    NullBuffer nullBuffer;
+    ostream* out;
+
+    static uint64_t elapsedNanos(chrono::steady_clock::time_point start) {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    static long peakRssKb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    void report(const string& name, size_t ops, size_t failures, uint64_t totalNanos,
+                LatencyRecorder& latencies) {
+        double seconds = totalNanos / 1e9;
+        *out << left << setw(10) << name << right
+            << " ops=" << setw(10) << ops
+            << " failed=" << setw(8) << failures
+            << " ops/sec=" << setw(12) << fixed << setprecision(0) << (seconds > 0 ? ops / seconds : 0)
+            << " p50=" << setw(8) << latencies.percentile(0.50) << "ns"
+            << " p99=" << setw(8) << latencies.percentile(0.99) << "ns"
+            << " peakRSS=" << peakRssKb() << "KB" << endl;
+    }
+
+    AccountHandle randomAccount() {
+        return accountIds[rng() % accountIds.size()];
+    }
+
+    void populate() {
+        size_t totalAccounts = config.customers * config.accountsPerCustomer;
+        LatencyRecorder latencies(totalAccounts);
+        auto populateStart = chrono::steady_clock::now();
+        accountIds.reserve(totalAccounts);
+        for (size_t c = 0; c < config.customers; ++c) {
+            CustomerHandle customerId = bank.createCustomerHandle("Bench", "Customer" + to_string(c),
+                                                    "bench" + to_string(c) + "@example.com",
+                                                    "555" + to_string(c), "1 Benchmark Way");
+            for (size_t a = 0; a < config.accountsPerCustomer; ++a) {
+                auto start = chrono::steady_clock::now();
+                accountIds.push_back(a % 2 == 0 ? bank.createSavingsAccount(customerId, Money::fromCents(100000000))
+                                                : bank.createCheckingAccount(customerId, Money::fromCents(100000000)));
+                latencies.record(elapsedNanos(start));
+            }
+        }
+        report("populate", totalAccounts, 0, elapsedNanos(populateStart), latencies);
+    }
+
+    // Submits transfers through a BankPipeline as fast as it accepts them; the
+    // latency of each runs from submission to its completion callback
+    void runPipeline(const string& name, size_t ops) {
+        vector<uint64_t> nanos(ops);
+        atomic<size_t> failures{ 0 };
+        auto loopStart = chrono::steady_clock::now();
+        {
+            BankPipeline pipeline(bank, BankPipeline::Config());
+            for (size_t i = 0; i < ops; ++i) {
+                auto start = chrono::steady_clock::now();
+                pipeline.submit(BankRequest::transfer(randomAccount(), randomAccount(), Money::fromCents(100)),
+                                [&nanos, &failures, i, start](const OperationResult& result, exception_ptr error) {
+                                    nanos[i] = elapsedNanos(start);
+                                    if (error || !result.ok()) {
+                                        failures++;
+                                    }
+                                });
+            }
+        }
+        uint64_t totalNanos = elapsedNanos(loopStart);
+        LatencyRecorder latencies(ops);
+        for (uint64_t sample : nanos) {
+            latencies.record(sample);
+        }
+        report(name, ops, failures, totalNanos, latencies);
+    }
+
+    // Runs one account operation in a tight loop against randomly chosen accounts;
+    // an operation fails by throwing or by returning a failed OperationResult
+    template <typename Operation>
+    void runLoop(const string& name, size_t ops, Operation operation) {
+        LatencyRecorder latencies(ops);
+        size_t failures = 0;
+        auto loopStart = chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            auto start = chrono::steady_clock::now();
+            try {
+                if constexpr (is_same_v<decltype(operation()), OperationResult>) {
+                    failures += operation().ok() ? 0 : 1;
+                } else {
+                    operation();
+                }
+            }
+            catch (const BankException&) {
+                failures++;
+            }
+            latencies.record(elapsedNanos(start));
+        }
+        report(name, ops, failures, elapsedNanos(loopStart), latencies);
+    }
+
+public:
+    BankBenchmark(const BenchmarkConfig& cfg)
+        : config(cfg), bank("Benchmark Bank"), rng(cfg.seed), out(nullptr) {}
+
+    void run() {
+        // Run quiet so no event formatting is measured; the report still prints
+        // to cout, so route that to a null buffer and write the results through
+        // a separate stream on the real console
+        BankEventSink* previousSink = BankEvents::getSink();
+        BankEvents::setSink(nullptr);
+        streambuf* console = cout.rdbuf(&nullBuffer);
+        ostream results(console);
+        out = &results;
+
+        *out << "=== Bank Benchmark ===" << endl;
+        *out << "customers=" << config.customers
+             << " accounts=" << config.customers * config.accountsPerCustomer
+             << " operations=" << config.operations << endl;
+
+        populate();
+
+        runLoop("deposit", config.operations, [this] {
+            bank.deposit(randomAccount(), Money::fromCents(100));
+        });
+        runLoop("withdraw", config.operations, [this] {
+            bank.withdraw(randomAccount(), Money::fromCents(100));
+        });
+        runLoop("transfer", config.operations, [this] {
+            AccountHandle from = randomAccount();
+            AccountHandle to = randomAccount();
+            bank.transfer(from, to, Money::fromCents(100));
+        });
+        // Declined card authorizations: every withdrawal exceeds the balance
+        runLoop("decline", config.operations, [this] {
+            bank.withdraw(randomAccount(), Money::fromCents(1000000000000));
+        });
+        runLoop("trydecline", config.operations, [this] {
+            return bank.tryWithdraw(randomAccount(), Money::fromCents(1000000000000));
+        });
+        runLoop("interest", config.interestRuns, [this] {
+            bank.processMonthlyInterest();
+        });
+        vector<TransferInstruction> batch(config.transferBatchSize);
+        runLoop("batch", config.operations / config.transferBatchSize, [&] {
+            for (auto& transfer : batch) {
+                transfer = TransferInstruction{ randomAccount(), randomAccount(), Money::fromCents(100) };
+            }
+            bank.transferBatch(batch);
+        });
+        runPipeline("pipeline", config.operations);
+        runLoop("lookup", config.operations, [this] {
+            size_t c = rng() % config.customers;
+            if (bank.findCustomersByEmail("bench" + to_string(c) + "@example.com").empty() ||
+                bank.findCustomersByLastName("Customer" + to_string(c), 1).empty()) {
+                throw BankException("Benchmark customer not indexed");
+            }
+        });
+        runLoop("report", config.reportRuns, [this] {
+            bank.generateBankReport();
+        });
+        runLoop("replay", 1, [this] {
+            if (!bank.auditLedger().consistent()) {
+                throw BankException("Benchmark balances do not match the ledger");
+            }
+        });
+
+        string snapshotFile = "bank_benchmark_" + to_string(getpid()) + ".snap";
+        runLoop("snapshot", 1, [&] {
+            bank.saveSnapshot(snapshotFile);
+        });
+        runLoop("restore", 1, [&] {
+            Bank restored("Benchmark Bank");
+            restored.loadSnapshot(snapshotFile);
+        });
+        remove(snapshotFile.c_str());
+
+        cout.rdbuf(console);
+        BankEvents::setSink(previousSink);
+        out = nullptr;
+    }
+};
+
+// Stress test configuration - concurrent transfer load on a small, hot set of accounts
+struct StressConfig {
+    size_t threads = 8;
+    size_t accounts = 64;
+    size_t operationsPerThread = 200000;
+    uint64_t seed = 7;
+    string walFile;                         // log the run here and check that it recovers
+    chrono::microseconds commitDelay{ 0 };
+};
+
+// BankStressTest class - hammers one Bank from many threads and checks that
+// money is conserved: transfers between accounts must never create or destroy
+// balance, and every successful operation must land in the ledger exactly once
+class BankStressTest {
+private:
+    StressConfig config;
+    Bank bank;
+    vector<AccountHandle> accountIds;
+    unique_ptr<BankPipeline> pipeline; // shared by the workers during the run
+
+    struct WorkerTotals {
+        size_t transfers = 0;
+        size_t deposits = 0;
+        size_t withdrawals = 0;
+        size_t rejected = 0;
+        int64_t netExternalCents = 0;
+    };
+
+    void worker(size_t threadIndex, WorkerTotals& totals) {
+        mt19937_64 rng(config.seed + threadIndex);
+        for (size_t i = 0; i < config.operationsPerThread; ++i) {
+            size_t choice = rng() % 16;
+            Money amount = Money::fromCents(1 + rng() % 10000);
+            try {
+                if (choice < 4) {
+                    // Opposite-direction transfers on one hot pair exercise lock ordering
+                    bool forward = (rng() & 1) != 0;
+                    bank.transfer(accountIds[forward ? 0 : 1], accountIds[forward ? 1 : 0], amount);
+                    totals.transfers++;
+                } else if (choice < 5) {
+                    // Batches lock many stripes at once, alongside the pair transfers
+                    vector<TransferInstruction> batch(1 + rng() % 16);
+                    for (auto& transfer : batch) {
+                        transfer = TransferInstruction{ accountIds[rng() % accountIds.size()],
+                                                        accountIds[rng() % accountIds.size()], amount };
+                    }
+                    bank.transferBatch(batch);
+                    totals.transfers += batch.size();
+                } else if (choice < 13) {
+                    AccountHandle from = accountIds[rng() % accountIds.size()];
+                    AccountHandle to = accountIds[rng() % accountIds.size()];
+                    // Some go through the asynchronous pipeline, batched with other threads' requests
+                    OperationResult result = choice == 12
+                                                 ? pipeline->submit(BankRequest::transfer(from, to, amount)).get()
+                                                 : bank.tryTransfer(from, to, amount);
+                    if (result.ok()) {
+                        totals.transfers++;
+                    } else {
+                        totals.rejected++;
+                    }
+                } else if (choice < 15) {
+                    bank.deposit(accountIds[rng() % accountIds.size()], amount);
+                    totals.deposits++;
+                    totals.netExternalCents += amount.getCents();
+                } else {
+                    bank.withdraw(accountIds[rng() % accountIds.size()], amount);
+                    totals.withdrawals++;
+                    totals.netExternalCents -= amount.getCents();
+                }
+            }
+            catch (const BankException&) {
+                totals.rejected++;
+            }
+        }
+    }
+
+public:
+    explicit BankStressTest(const StressConfig& cfg) : config(cfg), bank("Stress Test Bank") {}
+
+    // Returns true when balances and ledger are consistent after the run
+    bool run() {
+        BankEventSink* previousSink = BankEvents::getSink();
+        BankEvents::setSink(nullptr);
+
+        if (!config.walFile.empty()) {
+            struct stat info;
+            if (stat(config.walFile.c_str(), &info) == 0) {
+                BankEvents::setSink(previousSink);
+                cout << "Refusing to overwrite existing log " << config.walFile << endl;
+                return false;
+            }
+            bank.openWriteAheadLog(config.walFile, config.commitDelay);
+        }
+
+        const Money openingBalance = Money::fromCents(10000000);
+        for (size_t i = 0; i < config.accounts; ++i) {
+            CustomerHandle customerId = bank.createCustomerHandle("Stress", "Customer" + to_string(i),
+                                                                  "stress" + to_string(i) + "@example.com",
+                                                                  "555" + to_string(i), "1 Stress Way");
+            accountIds.push_back(bank.createSavingsAccount(customerId, openingBalance));
+        }
+
+        vector<WorkerTotals> totals(config.threads);
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        pipeline = make_unique<BankPipeline>(bank, BankPipeline::Config());
+        for (size_t t = 0; t < config.threads; ++t) {
+            workers.emplace_back(&BankStressTest::worker, this, t, ref(totals[t]));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        pipeline.reset();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        WorkerTotals combined;
+        for (const auto& t : totals) {
+            combined.transfers += t.transfers;
+            combined.deposits += t.deposits;
+            combined.withdrawals += t.withdrawals;
+            combined.rejected += t.rejected;
+            combined.netExternalCents += t.netExternalCents;
+        }
+
+        Money expectedTotal = Money::fromCents(openingBalance.getCents() * static_cast<int64_t>(config.accounts)
+                                               + combined.netExternalCents);
+        Money actualTotal;
+        for (AccountHandle accountId : accountIds) {
+            actualTotal += bank.balanceOf(*bank.findAccount(accountId));
+        }
+        size_t expectedRecords = config.accounts + combined.transfers + combined.deposits + combined.withdrawals;
+        size_t actualRecords = bank.getLedger().size();
+
+        vector<uint64_t> transactionIds;
+        transactionIds.reserve(actualRecords);
+        bank.getLedger().forEach([&](const Transaction& transaction) {
+            transactionIds.push_back(transaction.getTransactionId());
+        });
+        sort(transactionIds.begin(), transactionIds.end());
+        bool uniqueIds = adjacent_find(transactionIds.begin(), transactionIds.end()) == transactionIds.end();
+
+        bool aggregatesConsistent = bank.verifyAggregates(cout) &&
+                                    bank.summary().totalDeposits == actualTotal;
+        bool ledgerConsistent = bank.auditLedger().consistent();
+
+        // Replaying the log into a fresh bank must reproduce the same state
+        bool recovered = true;
+        if (!config.walFile.empty()) {
+            Bank replica("Stress Test Bank");
+            streambuf* console = cout.rdbuf(nullptr);
+            replica.replayWriteAheadLog(config.walFile);
+            cout.rdbuf(console);
+            BankSummary original = bank.summary(), replayed = replica.summary();
+            recovered = replayed.totalDeposits == original.totalDeposits &&
+                        replayed.transactions == original.transactions &&
+                        replayed.transactionsByType == original.transactionsByType &&
+                        replica.verifyAggregates(cout);
+        }
+
+        // A crash after a snapshot is published but before the log restarts
+        // from it leaves the new snapshot next to the old log. A bank recovered
+        // from the log, with no log of its own, saves a snapshot without
+        // restarting anything, which leaves the files in that state.
+        bool crashRecovered = true;
+        if (!config.walFile.empty()) {
+            string snapshotFile = config.walFile + ".snapshot";
+            streambuf* console = cout.rdbuf(nullptr);
+            try {
+                Bank published("Stress Test Bank");
+                published.replayWriteAheadLog(config.walFile);
+                published.saveSnapshot(snapshotFile);
+
+                Bank restarted("Stress Test Bank");
+                restarted.loadSnapshot(snapshotFile);
+                restarted.replayWriteAheadLog(config.walFile);
+                BankSummary original = bank.summary(), replayed = restarted.summary();
+                crashRecovered = replayed.totalDeposits == original.totalDeposits &&
+                                 replayed.transactions == original.transactions &&
+                                 restarted.verifyAggregates(cout);
+            }
+            catch (const BankException&) {
+                crashRecovered = false;
+            }
+            cout.rdbuf(console);
+            remove(snapshotFile.c_str());
+        }
+
+        bool passed = expectedTotal == actualTotal && expectedRecords == actualRecords && uniqueIds &&
+                      aggregatesConsistent && ledgerConsistent && recovered && crashRecovered;
+
+        BankEvents::setSink(previousSink);
+        size_t operations = config.threads * config.operationsPerThread;
+        cout << "=== Bank Stress Test ===" << endl;
+        cout << "threads=" << config.threads << " accounts=" << config.accounts
+             << " operations=" << operations << " rejected=" << combined.rejected
+             << " ops/sec=" << fixed << setprecision(0) << (seconds > 0 ? operations / seconds : 0) << endl;
+        cout << "total balance: expected $" << expectedTotal << ", actual $" << actualTotal << endl;
+        cout << "ledger records: expected " << expectedRecords << ", actual " << actualRecords << endl;
+        cout << "transaction IDs: " << (uniqueIds ? "unique" : "DUPLICATED") << endl;
+        cout << "aggregates: " << (aggregatesConsistent ? "consistent" : "MISMATCHED") << endl;
+        cout << "ledger replay: " << (ledgerConsistent ? "matches" : "DIFFERS") << endl;
+        if (!config.walFile.empty()) {
+            cout << "log recovery: " << (recovered ? "matches" : "DIFFERS") << endl;
+            cout << "crash before log restart: " << (crashRecovered ? "recovers" : "FAILS") << endl;
+        }
+        cout << (passed ? "PASS" : "FAIL") << endl;
+        return passed;
+    }
+};
+
+// BankProtocol - wire format of the socket server (--serve) and its load-test client
+// Every message is a frame: [u32 payload length][payload], integers in host
+// byte order (the server only listens on this machine). A request payload is
+// [u32 tag][u8 opcode][arguments] and its response [u32 tag][u8 status][results],
+// so a client may send many requests before reading any answers and match
+// them up by tag. Strings are [u32 length][bytes], amounts and balances i64
+// cents, times epoch seconds, and customers and accounts their u32 handle
+// values (CUST1001 is 0; AccountHandle for accounts).
+//
+//   opcode           arguments                              results
+//   CREATE_CUSTOMER  first, last, email, phone, address     u32 customer
+//   OPEN_SAVINGS     u32 customer, i64 deposit              u32 account
+//   OPEN_CHECKING    u32 customer, i64 deposit              u32 account
+//   OPEN_LOAN        u32 customer, i64 amount, u32 months   u32 account
+//   DEPOSIT          u32 account, i64 amount                i64 balance
+//   WITHDRAW         u32 account, i64 amount                i64 balance
+//   TRANSFER         u32 from, u32 to, i64 amount           i64 balance of from
+//   BALANCE          u32 account                            i64 balance
+//   ACCOUNT_INFO     u32 account                            u32 owner, u8 active, i64 balance, i64 opened
+//   CUSTOMER_INFO    u32 customer                           first, last, email, phone, address,
+//                                                           u32 n, u32 account x n
+//   FIND_EMAIL       email                                  u32 n, u32 customer x n
+//   HISTORY          u32 account, u32 limit, u64 cursor     u64 next cursor, u32 n, {u64 id, u8 type,
+//                                                           u32 from, u32 to, i64 amount, i64 time} x n
+//   REPORT           -                                      u64 customers, u32 savings, u32 checking,
+//                                                           u32 loans, u32 active, i64 deposits,
+//                                                           i64 loan exposure, i64 overdrawn, u64 transactions
+//
+// The status is an OperationStatus, or ERROR followed by a message string.
+// DEPOSIT, WITHDRAW, TRANSFER and BALANCE carry their balance whatever the
+// status; the other operations carry results only when the status is OK.
+class BankProtocol {
+public:
+    enum class Opcode : uint8_t {
+        CREATE_CUSTOMER = 1,
+        OPEN_SAVINGS,
+        OPEN_CHECKING,
+        OPEN_LOAN,
+        DEPOSIT,
+        WITHDRAW,
+        TRANSFER,
+        BALANCE,
+        ACCOUNT_INFO,
+        CUSTOMER_INFO,
+        FIND_EMAIL,
+        HISTORY,
+        REPORT
+    };
+
+    static constexpr uint8_t errorStatus = 255;
+    static constexpr uint32_t maxFrame = 1 << 16; // payload bytes; larger frames close the connection
+    static constexpr uint32_t maxHistory = 1000;  // records per HISTORY response
+
+    // Decodes one payload; throws if it ends early
+    class Reader {
+    private:
+        const char* bytes;
+        size_t length;
+        size_t pos = 0;
+
+        const char* take(size_t size) {
+            if (size > length - pos) {
+                throw BankException("Malformed request");
+            }
+            const char* start = bytes + pos;
+            pos += size;
+            return start;
+        }
+
+    public:
+        Reader(const char* data, size_t size) : bytes(data), length(size) {}
+
+        template <typename T>
+        T read() {
+            T value;
+            memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        string readString() {
+            uint32_t size = read<uint32_t>();
+            return string(take(size), size);
+        }
+
+        bool atEnd() const { return pos == length; }
+    };
+
+    // Appends frames to an output buffer
+    class Writer {
+    private:
+        vector<char>& bytes;
+        size_t frameStart = 0;
+
+    public:
+        explicit Writer(vector<char>& buffer) : bytes(buffer) {}
+
+        void put(const void* data, size_t size) {
+            const char* start = static_cast<const char*>(data);
+            bytes.insert(bytes.end(), start, start + size);
+        }
+
+        template <typename T>
+        void put(const T& value) { put(&value, sizeof(T)); }
+
+        void putString(string_view text) {
+            put(static_cast<uint32_t>(text.size()));
+            put(text.data(), text.size());
+        }
+
+        // Starts a frame; its length is filled in by endFrame
+        void beginFrame(uint32_t tag) {
+            frameStart = bytes.size();
+            put(uint32_t(0));
+            put(tag);
+        }
+
+        void truncate(size_t size) { bytes.resize(size); }
+
+        void endFrame() {
+            uint32_t length = static_cast<uint32_t>(bytes.size() - frameStart - sizeof(uint32_t));
+            memcpy(bytes.data() + frameStart, &length, sizeof(length));
+        }
+    };
+
+    // Returns the payload length of the complete frame at the start of data,
+    // or false if more bytes are needed
+    static bool frameAt(const char* data, size_t size, uint32_t& length) {
+        if (size < sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&length, data, sizeof(length));
+        return size - sizeof(uint32_t) >= length;
+    }
+};
+
+// Address a server listens on: "unix:<path>" for a Unix domain socket, or
+// "[host:]port" for TCP (host defaults to 127.0.0.1)
+struct SocketAddress {
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+    string unixPath; // empty for TCP
+
+    static SocketAddress parse(const string& text) {
+        SocketAddress address;
+        if (text.compare(0, 5, "unix:") == 0) {
+            address.unixPath = text.substr(5);
+            sockaddr_un* local = reinterpret_cast<sockaddr_un*>(&address.storage);
+            if (address.unixPath.empty() || address.unixPath.size() >= sizeof(local->sun_path)) {
+                throw runtime_error("bad socket path " + address.unixPath);
+            }
+            local->sun_family = AF_UNIX;
+            memcpy(local->sun_path, address.unixPath.c_str(), address.unixPath.size() + 1);
+            address.length = sizeof(sockaddr_un);
+            return address;
+        }
+        size_t colon = text.rfind(':');
+        string host = colon == string::npos ? "127.0.0.1" : text.substr(0, colon);
+        string port = colon == string::npos ? text : text.substr(colon + 1);
+        sockaddr_in* inet = reinterpret_cast<sockaddr_in*>(&address.storage);
+        inet->sin_family = AF_INET;
+        int number = port.empty() || port.size() > 5 || !all_of(port.begin(), port.end(), ::isdigit) ? -1 : stoi(port);
+        if (number < 0 || number > 65535 || inet_pton(AF_INET, host.c_str(), &inet->sin_addr) != 1) {
+            throw runtime_error("bad address " + text + " (expected unix:<path> or [host:]port)");
+        }
+        inet->sin_port = htons(static_cast<uint16_t>(number));
+        address.length = sizeof(sockaddr_in);
+        return address;
+    }
+
+    int family() const { return storage.ss_family; }
+    const sockaddr* get() const { return reinterpret_cast<const sockaddr*>(&storage); }
+};
+
+struct ServerConfig {
+    string address;
+    size_t workers = 2;                // BankPipeline workers for money operations
+    size_t maxInFlight = 1024;         // pipelined requests per connection before reads pause
+    size_t maxPendingOutput = 1 << 20; // unsent response bytes per connection before reads pause
+    size_t maxPendingInput = 1 << 20;  // unparsed request bytes per connection before reads pause
+};
+
+// BankServer class - serves BankProtocol on a local socket
+// One thread runs an epoll loop over the listening socket, the connections, a
+// signalfd (SIGINT and SIGTERM stop the server) and an eventfd. Deposits,
+// withdrawals, transfers and balance queries are handed to a BankPipeline;
+// its workers queue the answers and wake the loop through the eventfd, so
+// many requests from many connections are in flight at once and each
+// worker's group shares its locking and log sync. Requests that act first on
+// the same account run in the order sent. Every other operation runs on the
+// loop thread once the connection's earlier requests have all been answered,
+// so a connection sees its own writes. A connection stops being read while it
+// has maxInFlight requests outstanding or maxPendingOutput bytes unsent.
+class BankServer {
+private:
+    static constexpr size_t compactThreshold = 64 << 10; // consumed buffer bytes kept before they are erased
+
+    struct Connection {
+        int fd;
+        uint64_t id;
+        vector<char> input;
+        size_t inputStart = 0;  // first unparsed byte
+        vector<char> output;
+        size_t outputStart = 0; // first unsent byte
+        size_t inFlight = 0;
+        uint32_t events = 0;    // registered epoll interest
+        bool peerClosed = false;
+    };
+
+    // An answer from a pipeline worker
+    struct Completion {
+        uint64_t connection;
+        uint32_t tag;
+        OperationResult result;
+        string error; // set if the request could not be executed
+    };
+
+    ServerConfig config;
+    Bank& bank;
+    SocketAddress address;
+    int listenFd = -1;
+    int epollFd = -1;
+    int signalFd = -1;
+    int wakeFd = -1;
+    unordered_map<uint64_t, unique_ptr<Connection>> connections;
+    uint64_t nextConnection = 2; // 0 and 1 tag the listener and the signalfd
+    unique_ptr<BankPipeline> pipeline;
+
+    mutex completionMutex;
+    vector<Completion> completions; // filled by pipeline workers
+    vector<Completion> draining;    // the batch the loop is answering
+    uint64_t served = 0;
+
+    static const uint64_t listenerTag = 0;
+    static const uint64_t signalTag = 1;
+    static const uint64_t wakeTag = UINT64_MAX;
+
+    static void check(int result, const char* what) {
+        if (result < 0) {
+            throw runtime_error(string(what) + ": " + strerror(errno));
+        }
+    }
+
+    void watch(int fd, uint32_t events, uint64_t tag) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = tag;
+        check(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event), "epoll_ctl");
+    }
+
+    // Answers a request that failed with one of the statuses, dropping any
+    // part of its response already written
+    static void writeStatus(BankProtocol::Writer& out, uint32_t tag, OperationStatus status, size_t responseStart) {
+        out.truncate(responseStart);
+        out.beginFrame(tag);
+        out.put(status);
+        out.endFrame();
+    }
+
+    static bool isPipelined(BankProtocol::Opcode opcode) {
+        return opcode == BankProtocol::Opcode::DEPOSIT || opcode == BankProtocol::Opcode::WITHDRAW ||
+               opcode == BankProtocol::Opcode::TRANSFER || opcode == BankProtocol::Opcode::BALANCE;
+    }
+
+    static void writeError(BankProtocol::Writer& out, uint32_t tag, const string& message) {
+        out.beginFrame(tag);
+        out.put(BankProtocol::errorStatus);
+        out.putString(message);
+        out.endFrame();
+    }
+
+    static BankRequest decode(BankProtocol::Opcode opcode, BankProtocol::Reader& in) {
+        AccountHandle accountId{ in.read<uint32_t>() };
+        BankRequest request = BankRequest::balance(accountId);
+        if (opcode == BankProtocol::Opcode::TRANSFER) {
+            AccountHandle to{ in.read<uint32_t>() };
+            request = BankRequest::transfer(accountId, to, Money::fromCents(in.read<int64_t>()));
+        } else if (opcode == BankProtocol::Opcode::DEPOSIT) {
+            request = BankRequest::deposit(accountId, Money::fromCents(in.read<int64_t>()));
+        } else if (opcode == BankProtocol::Opcode::WITHDRAW) {
+            request = BankRequest::withdraw(accountId, Money::fromCents(in.read<int64_t>()));
+        }
+        if (!in.atEnd()) {
+            throw BankException("Malformed request");
+        }
+        return request;
+    }
+
+    void submit(Connection& connection, uint32_t tag, const BankRequest& request) {
+        ++connection.inFlight;
+        uint64_t id = connection.id;
+        pipeline->submit(request, [this, id, tag](const OperationResult& result, exception_ptr error) {
+            Completion completion{ id, tag, result, string() };
+            if (error) {
+                try {
+                    rethrow_exception(error);
+                }
+                catch (const exception& e) {
+                    completion.error = e.what();
+                }
+            }
+            bool wasEmpty;
+            {
+                lock_guard<mutex> lock(completionMutex);
+                wasEmpty = completions.empty();
+                completions.push_back(move(completion));
+            }
+            if (wasEmpty) {
+                uint64_t one = 1;
+                ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+                (void)ignored;
+            }
+        });
+    }
+
+    // Runs an operation that is not pipelined and appends its response
+    void execute(BankProtocol::Opcode opcode, uint32_t tag, BankProtocol::Reader& in, BankProtocol::Writer& out) {
+        using Opcode = BankProtocol::Opcode;
+        switch (opcode) {
+            case Opcode::CREATE_CUSTOMER: {
+                string fields[5];
+                for (string& field : fields) {
+                    field = in.readString();
+                }
+                CustomerHandle customerId = bank.createCustomerHandle(fields[0], fields[1], fields[2],
+                                                                      fields[3], fields[4]);
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(customerId.value);
+                break;
+            }
+            case Opcode::OPEN_SAVINGS:
+            case Opcode::OPEN_CHECKING:
+            case Opcode::OPEN_LOAN: {
+                CustomerHandle customerId{ in.read<uint32_t>() };
+                Money amount = Money::fromCents(in.read<int64_t>());
+                AccountHandle accountId;
+                if (opcode == Opcode::OPEN_SAVINGS) {
+                    accountId = bank.createSavingsAccount(customerId, amount);
+                } else if (opcode == Opcode::OPEN_CHECKING) {
+                    accountId = bank.createCheckingAccount(customerId, amount);
+                } else {
+                    accountId = bank.createLoanAccount(customerId, amount, static_cast<int>(in.read<uint32_t>()));
+                }
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(accountId.value);
+                break;
+            }
+            case Opcode::ACCOUNT_INFO: {
+                shared_ptr<Account> account = bank.findAccount(AccountHandle{ in.read<uint32_t>() });
+                if (!account) {
+                    throw AccountNotFoundException();
+                }
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(account->getOwner().value);
+                out.put(static_cast<uint8_t>(account->getIsActive()));
+                out.put(bank.balanceOf(*account).getCents());
+                out.put(account->getCreationTime());
+                break;
+            }
+            case Opcode::CUSTOMER_INFO: {
+                shared_ptr<Customer> customer = bank.findCustomer(CustomerHandle{ in.read<uint32_t>() });
+                if (!customer) {
+                    throw AccountNotFoundException();
+                }
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                for (string_view field : { customer->getFirstName(), customer->getLastName(), customer->getEmail(),
+                                           customer->getPhone(), customer->getAddress() }) {
+                    out.putString(field);
+                }
+                const vector<AccountHandle>& accountIds = customer->getAccountIds();
+                out.put(static_cast<uint32_t>(accountIds.size()));
+                for (AccountHandle accountId : accountIds) {
+                    out.put(accountId.value);
+                }
+                break;
+            }
+            case Opcode::FIND_EMAIL: {
+                vector<shared_ptr<Customer>> matches = bank.findCustomersByEmail(in.readString());
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(static_cast<uint32_t>(matches.size()));
+                for (const auto& customer : matches) {
+                    out.put(customer->getHandle().value);
+                }
+                break;
+            }
+            case Opcode::HISTORY: {
+                AccountHandle accountId{ in.read<uint32_t>() };
+                HistoryQuery query;
+                query.limit = min(in.read<uint32_t>(), BankProtocol::maxHistory);
+                query.cursor = in.read<uint64_t>();
+                HistoryPage page = bank.queryHistory(accountId, query);
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(page.nextCursor);
+                out.put(static_cast<uint32_t>(page.transactions.size()));
+                for (const Transaction& transaction : page.transactions) {
+                    out.put(transaction.getTransactionId());
+                    out.put(static_cast<uint8_t>(transaction.getType()));
+                    out.put(transaction.getFrom().value);
+                    out.put(transaction.getTo().value);
+                    out.put(transaction.getAmount().getCents());
+                    out.put(transaction.getTimestampEpoch());
+                }
+                break;
+            }
+            case Opcode::REPORT: {
+                BankSummary summary = bank.summary();
+                out.beginFrame(tag);
+                out.put(OperationStatus::OK);
+                out.put(static_cast<uint64_t>(summary.customers));
+                for (uint32_t count : { summary.savingsAccounts, summary.checkingAccounts,
+                                        summary.loanAccounts, summary.activeAccounts }) {
+                    out.put(count);
+                }
+                for (Money total : { summary.totalDeposits, summary.loanExposure, summary.overdrawn }) {
+                    out.put(total.getCents());
+                }
+                out.put(summary.transactions);
+                break;
+            }
+            default:
+                throw BankException("Unknown operation");
+        }
+        if (!in.atEnd()) {
+            throw BankException("Malformed request");
+        }
+        out.endFrame();
+    }
+
+    // Parses and starts the connection's complete requests; stops early at a
+    // non-pipelined request while earlier ones are still running, or once the
+    // connection has too much outstanding. Returns false if the connection
+    // announced a frame that cannot be a request.
+    bool processInput(Connection& connection) {
+        BankProtocol::Writer out(connection.output);
+        for (;;) {
+            const char* frame = connection.input.data() + connection.inputStart;
+            size_t available = connection.input.size() - connection.inputStart;
+            uint32_t length;
+            bool complete = BankProtocol::frameAt(frame, available, length);
+            if (available >= sizeof(uint32_t) &&
+                (length > BankProtocol::maxFrame || length < sizeof(uint32_t) + sizeof(uint8_t))) {
+                return false;
+            }
+            if (!complete || connection.inFlight >= config.maxInFlight ||
+                connection.output.size() - connection.outputStart >= config.maxPendingOutput) {
+                break;
+            }
+            BankProtocol::Reader in(frame + sizeof(uint32_t), length);
+            uint32_t tag = in.read<uint32_t>();
+            auto opcode = static_cast<BankProtocol::Opcode>(in.read<uint8_t>());
+            if (!isPipelined(opcode) && connection.inFlight != 0) {
+                break;
+            }
+            connection.inputStart += sizeof(uint32_t) + length;
+            ++served;
+            size_t responseStart = connection.output.size();
+            try {
+                if (isPipelined(opcode)) {
+                    submit(connection, tag, decode(opcode, in));
+                } else {
+                    execute(opcode, tag, in, out);
+                }
+            }
+            catch (const InsufficientFundsException&) {
+                writeStatus(out, tag, OperationStatus::INSUFFICIENT_FUNDS, responseStart);
+            }
+            catch (const AccountNotFoundException&) {
+                writeStatus(out, tag, OperationStatus::ACCOUNT_NOT_FOUND, responseStart);
+            }
+            catch (const InvalidAmountException&) {
+                writeStatus(out, tag, OperationStatus::INVALID_AMOUNT, responseStart);
+            }
+            catch (const exception& e) {
+                out.truncate(responseStart);
+                writeError(out, tag, e.what());
+            }
+        }
+        if (connection.inputStart == connection.input.size()) {
+            connection.input.clear();
+            connection.inputStart = 0;
+        } else if (connection.inputStart >= compactThreshold) {
+            // A partial frame or paused requests remain; drop what has been parsed
+            connection.input.erase(connection.input.begin(), connection.input.begin() + connection.inputStart);
+            connection.inputStart = 0;
+        }
+        return true;
+    }
+
+    // Writes as much pending output as the socket takes; false on a write error
+    bool flush(Connection& connection) {
+        while (connection.outputStart < connection.output.size()) {
+            ssize_t sent = ::send(connection.fd, connection.output.data() + connection.outputStart,
+                                  connection.output.size() - connection.outputStart, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    return false;
+                }
+                // The socket is full; drop what has been sent
+                if (connection.outputStart >= compactThreshold) {
+                    connection.output.erase(connection.output.begin(),
+                                            connection.output.begin() + connection.outputStart);
+                    connection.outputStart = 0;
+                }
+                return true;
+            }
+            connection.outputStart += sent;
+        }
+        connection.output.clear();
+        connection.outputStart = 0;
+        return true;
+    }
+
+    void close(uint64_t id) {
+        auto found = connections.find(id);
+        if (found != connections.end()) {
+            ::close(found->second->fd); // also removes it from the epoll set
+            connections.erase(found);
+        }
+    }
+
+    // Flushes, then closes the connection or updates what it is polled for
+    void settle(Connection& connection) {
+        if (!flush(connection)) {
+            close(connection.id);
+            return;
+        }
+        bool outputPending = connection.outputStart < connection.output.size();
+        if (connection.peerClosed && connection.inFlight == 0 && !outputPending) {
+            close(connection.id);
+            return;
+        }
+        uint32_t events = 0;
+        if (!connection.peerClosed && connection.inFlight < config.maxInFlight &&
+            connection.input.size() - connection.inputStart < config.maxPendingInput &&
+            connection.output.size() - connection.outputStart < config.maxPendingOutput) {
+            events |= EPOLLIN;
+        }
+        if (outputPending) {
+            events |= EPOLLOUT;
+        }
+        if (events != connection.events) {
+            epoll_event event{};
+            event.events = events;
+            event.data.u64 = connection.id;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.events = events;
+        }
+    }
+
+    void accept() {
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return; // EAGAIN, or a connection that went away before it was taken
+            }
+            if (address.family() == AF_INET) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+            auto connection = make_unique<Connection>();
+            connection->fd = fd;
+            connection->id = nextConnection++;
+            connection->events = EPOLLIN;
+            watch(fd, EPOLLIN, connection->id);
+            connections.emplace(connection->id, move(connection));
+        }
+    }
+
+    void readFrom(Connection& connection) {
+        char chunk[1 << 16];
+        for (int reads = 0; reads < 16; ++reads) {
+            ssize_t received = ::recv(connection.fd, chunk, sizeof(chunk), 0);
+            if (received > 0) {
+                connection.input.insert(connection.input.end(), chunk, chunk + received);
+                if (static_cast<size_t>(received) < sizeof(chunk)) break;
+            } else if (received == 0) {
+                connection.peerClosed = true;
+                break;
+            } else if (errno != EINTR) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    connection.peerClosed = true;
+                    connection.input.clear();
+                    connection.inputStart = 0;
+                }
+                break;
+            }
+        }
+    }
+
+    // Answers the requests the pipeline has finished
+    void complete() {
+        uint64_t counter;
+        ssize_t ignored = ::read(wakeFd, &counter, sizeof(counter));
+        (void)ignored;
+        {
+            lock_guard<mutex> lock(completionMutex);
+            draining.swap(completions);
+        }
+        vector<uint64_t> touched;
+        for (const Completion& completion : draining) {
+            auto found = connections.find(completion.connection);
+            if (found == connections.end()) {
+                continue; // the client hung up
+            }
+            Connection& connection = *found->second;
+            BankProtocol::Writer out(connection.output);
+            if (!completion.error.empty()) {
+                writeError(out, completion.tag, completion.error);
+            } else {
+                out.beginFrame(completion.tag);
+                out.put(completion.result.status);
+                out.put(completion.result.balance.getCents());
+                out.endFrame();
+            }
+            --connection.inFlight;
+            touched.push_back(connection.id);
+        }
+        draining.clear();
+        sort(touched.begin(), touched.end());
+        touched.erase(unique(touched.begin(), touched.end()), touched.end());
+        for (uint64_t id : touched) {
+            auto found = connections.find(id);
+            if (found != connections.end() && processInput(*found->second)) {
+                settle(*found->second);
+            } else {
+                close(id);
+            }
+        }
+    }
+
+    void open() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        check(epollFd, "epoll_create1");
+
+        listenFd = socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        check(listenFd, "socket");
+        if (address.family() == AF_UNIX) {
+            ::unlink(address.unixPath.c_str()); // a stale socket from an earlier run
+        } else {
+            int on = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+        check(::bind(listenFd, address.get(), address.length), "bind");
+        check(::listen(listenFd, SOMAXCONN), "listen");
+        watch(listenFd, EPOLLIN, listenerTag);
+
+        sigset_t signals = blockStopSignals();
+        signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        check(signalFd, "signalfd");
+        watch(signalFd, EPOLLIN, signalTag);
+
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        check(wakeFd, "eventfd");
+        watch(wakeFd, EPOLLIN, wakeTag);
+
+        BankPipeline::Config pipelineConfig;
+        pipelineConfig.workers = config.workers;
+        pipeline = make_unique<BankPipeline>(bank, pipelineConfig);
+    }
+
+public:
+    BankServer(Bank& target, const ServerConfig& cfg)
+        : config(cfg), bank(target), address(SocketAddress::parse(cfg.address)) {
+        config.maxInFlight = max<size_t>(1, config.maxInFlight);
+    }
+
+    ~BankServer() {
+        pipeline.reset(); // finishes the queued requests before their connections go
+        for (auto& entry : connections) {
+            ::close(entry.second->fd);
+        }
+        for (int fd : { listenFd, epollFd, signalFd, wakeFd }) {
+            if (fd >= 0) ::close(fd);
+        }
+        if (listenFd >= 0 && !address.unixPath.empty()) {
+            ::unlink(address.unixPath.c_str());
+        }
+    }
+
+    BankServer(const BankServer&) = delete;
+    BankServer& operator=(const BankServer&) = delete;
+
+    // SIGINT and SIGTERM stop the server by being read from a signalfd, so
+    // every thread must block them: call this before starting any thread
+    // (the write-ahead log's flusher, say). The pipeline's workers inherit it.
+    static sigset_t blockStopSignals() {
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        return signals;
+    }
+
+    // Serves until SIGINT or SIGTERM
+    void run() {
+        open();
+        cout << "Serving on " << config.address << endl;
+
+        epoll_event events[256];
+        bool stopping = false;
+        while (!stopping) {
+            int ready = epoll_wait(epollFd, events, 256, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                check(ready, "epoll_wait");
+            }
+            for (int i = 0; i < ready; ++i) {
+                uint64_t tag = events[i].data.u64;
+                if (tag == listenerTag) {
+                    accept();
+                } else if (tag == signalTag) {
+                    stopping = true;
+                } else if (tag == wakeTag) {
+                    complete();
+                } else {
+                    auto found = connections.find(tag);
+                    if (found == connections.end()) {
+                        continue; // closed earlier in this batch
+                    }
+                    Connection& connection = *found->second;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        readFrom(connection);
+                    }
+                    // Sending first lets a connection paused on unsent output resume
+                    if (flush(connection) && processInput(connection)) {
+                        settle(connection);
+                    } else {
+                        close(tag);
+                    }
+                }
+            }
+        }
+        cout << "Server stopped after " << served << " requests" << endl;
+    }
+};
+
+struct LoadTestConfig {
+    string address;
+    size_t connections = 4;
+    size_t requestsPerConnection = 100000;
+    size_t depth = 32;     // requests each connection keeps outstanding
+    size_t accounts = 1000;
+    uint64_t seed = 11;
+};
+
+// BankLoadTest class - measures a running BankServer end to end. It opens its
+// accounts through the server, then each connection, on its own thread, keeps
+// depth requests outstanding (a mix of transfers, deposits, withdrawals and
+// balance queries) and times every request from send to answer.
+class BankLoadTest {
+private:
+    // Blocking client connection
+    class Client {
+    private:
+        int fd;
+        vector<char> input;
+        size_t inputStart = 0;
+        vector<char> output;
+
+    public:
+        explicit Client(const SocketAddress& address) {
+            fd = socket(address.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0 || connect(fd, address.get(), address.length) < 0) {
+                string reason = strerror(errno);
+                if (fd >= 0) ::close(fd);
+                throw runtime_error("cannot connect: " + reason);
+            }
+            if (address.family() == AF_INET) {
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+        }
+
+        ~Client() { ::close(fd); }
+
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+
+        BankProtocol::Writer request(uint32_t tag, BankProtocol::Opcode opcode) {
+            BankProtocol::Writer out(output);
+            out.beginFrame(tag);
+            out.put(opcode);
+            return out;
+        }
+
+        // Sends every queued request
+        void flush() {
+            size_t sent = 0;
+            while (sent < output.size()) {
+                ssize_t n = ::send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) throw runtime_error("send failed: " + string(strerror(errno)));
+                sent += n;
+            }
+            output.clear();
+        }
+
+        // Waits for the next response; returns its payload after the tag and status
+        BankProtocol::Reader response(uint32_t& tag, uint8_t& status) {
+            uint32_t length;
+            while (!BankProtocol::frameAt(input.data() + inputStart, input.size() - inputStart, length)) {
+                if (inputStart != 0) {
+                    input.erase(input.begin(), input.begin() + inputStart);
+                    inputStart = 0;
+                }
+                size_t used = input.size();
+                input.resize(used + (1 << 16));
+                ssize_t n = ::recv(fd, input.data() + used, 1 << 16, 0);
+                input.resize(used + max<ssize_t>(n, 0));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) throw runtime_error("server closed the connection");
+            }
+            BankProtocol::Reader in(input.data() + inputStart + sizeof(uint32_t), length);
+            inputStart += sizeof(uint32_t) + length;
+            tag = in.read<uint32_t>();
+            status = in.read<uint8_t>();
+            return in;
+        }
+
+        bool hasResponse() const {
+            uint32_t length;
+            return BankProtocol::frameAt(input.data() + inputStart, input.size() - inputStart, length);
+        }
+
+        // Sends one request and waits for its answer; throws unless it succeeded
+        BankProtocol::Reader call(BankProtocol::Writer request) {
+            request.endFrame();
+            flush();
+            uint32_t tag;
+            uint8_t status;
+            BankProtocol::Reader in = response(tag, status);
+            if (status == BankProtocol::errorStatus) {
+                throw runtime_error(in.readString());
+            }
+            if (status != static_cast<uint8_t>(OperationStatus::OK)) {
+                throw runtime_error(statusMessage(static_cast<OperationStatus>(status)));
+            }
+            return in;
+        }
+    };
+
+    struct WorkerTotals {
+        vector<uint64_t> latencies; // nanoseconds
+        size_t rejected = 0;
+        size_t errors = 0;
+    };
+
+    LoadTestConfig config;
+    SocketAddress address;
+    vector<uint32_t> accountIds;
+
+    void openAccounts() {
+        Client client(address);
+        BankProtocol::Writer customer = client.request(0, BankProtocol::Opcode::CREATE_CUSTOMER);
+        for (const char* field : { "Load", "Test", "loadtest@example.com", "5550000", "1 Load Test Way" }) {
+            customer.putString(field);
+        }
+        uint32_t customerId = client.call(customer).read<uint32_t>();
+        for (size_t i = 0; i < config.accounts; ++i) {
+            BankProtocol::Writer open = client.request(0, BankProtocol::Opcode::OPEN_CHECKING);
+            open.put(customerId);
+            open.put(int64_t(100000));
+            accountIds.push_back(client.call(open).read<uint32_t>());
+        }
+    }
+
+    void queueRequest(Client& client, uint32_t tag, mt19937_64& rng) {
+        size_t choice = rng() % 20;
+        uint32_t accountId = accountIds[rng() % accountIds.size()];
+        int64_t cents = 1 + rng() % 10000;
+        if (choice < 10) {
+            BankProtocol::Writer out = client.request(tag, BankProtocol::Opcode::TRANSFER);
+            out.put(accountId);
+            out.put(accountIds[rng() % accountIds.size()]);
+            out.put(cents);
+            out.endFrame();
+        } else if (choice < 18) {
+            BankProtocol::Writer out = client.request(tag, choice < 15 ? BankProtocol::Opcode::DEPOSIT
+                                                                       : BankProtocol::Opcode::WITHDRAW);
+            out.put(accountId);
+            out.put(cents);
+            out.endFrame();
+        } else {
+            BankProtocol::Writer out = client.request(tag, BankProtocol::Opcode::BALANCE);
+            out.put(accountId);
+            out.endFrame();
+        }
+    }
+
+    // Tags are slots 0..depth-1; an answered slot is reused for the next request
+    void worker(size_t index, WorkerTotals& totals) {
+        Client client(address);
+        mt19937_64 rng(config.seed + index);
+        size_t total = config.requestsPerConnection;
+        vector<chrono::steady_clock::time_point> sentAt(min(config.depth, total));
+        totals.latencies.reserve(total);
+
+        size_t sent = 0;
+        auto now = chrono::steady_clock::now();
+        for (; sent < sentAt.size(); ++sent) {
+            queueRequest(client, static_cast<uint32_t>(sent), rng);
+            sentAt[sent] = now;
+        }
+        client.flush();
+
+        for (size_t answered = 0; answered < total; ++answered) {
+            uint32_t tag;
+            uint8_t status;
+            client.response(tag, status);
+            now = chrono::steady_clock::now();
+            if (tag >= sentAt.size()) {
+                throw runtime_error("response to a request never sent");
+            }
+            totals.latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(now - sentAt[tag]).count());
+            if (status == BankProtocol::errorStatus) {
+                ++totals.errors;
+            } else if (status != static_cast<uint8_t>(OperationStatus::OK)) {
+                ++totals.rejected;
+            }
+            if (sent < total) {
+                queueRequest(client, tag, rng);
+                sentAt[tag] = now;
+                ++sent;
+            }
+            if (!client.hasResponse()) {
+                client.flush();
+            }
+        }
+    }
+
+public:
+    explicit BankLoadTest(const LoadTestConfig& cfg) : config(cfg), address(SocketAddress::parse(cfg.address)) {
+        config.connections = max<size_t>(1, config.connections);
+        config.depth = max<size_t>(1, config.depth);
+        config.accounts = max<size_t>(2, config.accounts);
+    }
+
+    void run() {
+        openAccounts();
+        vector<WorkerTotals> totals(config.connections);
+        vector<thread> threads;
+        vector<string> failures(config.connections);
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < config.connections; ++i) {
+            threads.emplace_back([this, i, &totals, &failures] {
+                try {
+                    worker(i, totals[i]);
+                }
+                catch (const exception& e) {
+                    failures[i] = e.what();
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        vector<uint64_t> latencies;
+        size_t rejected = 0;
+        size_t errors = 0;
+        for (size_t i = 0; i < config.connections; ++i) {
+            if (!failures[i].empty()) {
+                throw runtime_error("connection " + to_string(i) + ": " + failures[i]);
+            }
+            latencies.insert(latencies.end(), totals[i].latencies.begin(), totals[i].latencies.end());
+            rejected += totals[i].rejected;
+            errors += totals[i].errors;
+        }
+        auto percentile = [&](double p) -> uint64_t {
+            if (latencies.empty()) return 0;
+            size_t rank = static_cast<size_t>(p * (latencies.size() - 1));
+            nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+            return latencies[rank];
+        };
+        cout << "connections=" << config.connections << " depth=" << config.depth
+             << " requests=" << latencies.size() << " rejected=" << rejected << " errors=" << errors << endl;
+        cout << "req/sec=" << fixed << setprecision(0) << (seconds > 0 ? latencies.size() / seconds : 0)
+             << " p50=" << percentile(0.50) << "ns"
+             << " p99=" << percentile(0.99) << "ns"
+             << " p99.9=" << percentile(0.999) << "ns"
+             << " max=" << percentile(1.0) << "ns" << endl;
+    }
+};
+
+// ZipfianSampler - draws ranks 0..n-1 with P(rank k) proportional to
+// 1/(k+1)^theta in constant time, using the method of Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases" (as in YCSB); theta must be
+// in [0, 1), and 0 is uniform. Construction sums n terms once.
+class ZipfianSampler {
+private:
+    uint64_t items;
+    double theta;
+    double alpha;
+    double zetaN;
+    double eta;
+    double secondThreshold; // 1 + 0.5^theta
+
+public:
+    ZipfianSampler(uint64_t n, double skew) : items(max<uint64_t>(1, n)), theta(skew) {
+        if (!(theta >= 0 && theta < 1)) {
+            throw invalid_argument("Zipfian skew must be at least 0 and below 1");
+        }
+        zetaN = 0;
+        for (uint64_t i = 1; i <= items; ++i) {
+            zetaN += 1 / pow(static_cast<double>(i), theta);
+        }
+        secondThreshold = 1 + pow(0.5, theta);
+        alpha = 1 / (1 - theta);
+        eta = items > 2 ? (1 - pow(2.0 / items, 1 - theta)) / (1 - secondThreshold / zetaN) : 0;
+    }
+
+    // u is uniform in [0, 1)
+    uint64_t sample(double u) const {
+        double scaled = u * zetaN;
+        if (scaled < 1) return 0;
+        if (scaled < secondThreshold) return min<uint64_t>(1, items - 1);
+        return min<uint64_t>(items - 1, static_cast<uint64_t>(items * pow(eta * u - eta + 1, alpha)));
+    }
+};
+
+struct WorkloadConfig {
+    size_t customers = 10000;
+    size_t accountsPerCustomer = 2;
+    array<double, 3> accountMix{ { 50, 40, 10 } };   // savings, checking, loan weights
+    size_t operations = 1000000;
+    array<double, 3> operationMix{ { 30, 30, 40 } }; // deposit, withdrawal, transfer weights
+    Money amountMedian = Money::fromCents(5000);     // amounts are log-normal around this
+    double amountSpread = 1.0;  // standard deviation of the amount's natural log
+    double skew = 0.99;         // Zipfian exponent of account popularity; 0 is uniform
+    double declineRate = 0;     // share of withdrawals and transfers made to fail
+    uint64_t seed = 1;
+    string outputFile;          // write a batch script instead of running the workload
+
+    // Sets one key=value option, as given to --workload
+    void set(const string& key, const string& value) {
+        auto weights = [&](array<double, 3>& target) {
+            stringstream parts(value);
+            string part;
+            for (double& weight : target) {
+                if (!getline(parts, part, ',') || (weight = stod(part)) < 0) {
+                    throw invalid_argument(key + " takes three non-negative weights, e.g. 50,40,10");
+                }
+            }
+        };
+        if (key == "customers") customers = stoull(value);
+        else if (key == "accounts") accountsPerCustomer = max<size_t>(1, stoull(value));
+        else if (key == "types") weights(accountMix);
+        else if (key == "ops") operations = stoull(value);
+        else if (key == "mix") weights(operationMix);
+        else if (key == "amount") {
+            if (!Money::parse(value, amountMedian) || amountMedian <= Money()) {
+                throw invalid_argument("bad amount " + value);
+            }
+        }
+        else if (key == "spread") amountSpread = max(0.0, stod(value));
+        else if (key == "skew") {
+            skew = stod(value);
+            if (!(skew >= 0 && skew < 1)) {
+                throw invalid_argument("skew must be at least 0 and below 1");
+            }
+        }
+        else if (key == "decline") declineRate = min(1.0, max(0.0, stod(value)));
+        else if (key == "seed") seed = stoull(value);
+        else if (key == "out") outputFile = value;
+        else throw invalid_argument("unknown workload option '" + key + "'");
+    }
+};
+
+// WorkloadGenerator class - reproducible synthetic traffic for a Bank
+// Creates the configured customers with a weighted mix of savings, checking
+// and loan accounts, then a stream of deposits, withdrawals and transfers.
+// Accounts are picked by Zipfian popularity over a seeded shuffle of the
+// accounts, so the hot accounts are spread across customers and types;
+// withdrawals and transfers are drawn from savings and checking accounts.
+// A declineRate share of the withdrawals and transfers is made to fail (too
+// large, zero, or an unknown account) on top of those that fail naturally.
+// Random numbers come from mt19937_64 with fixed conversions rather than the
+// standard distributions, so a seed gives the same stream on every run.
+// run() drives a Bank directly; write() produces the same stream as a batch
+// script for --batch on an empty bank.
+class WorkloadGenerator {
+private:
+    static constexpr size_t maxLatencySamples = 1 << 20;
+
+    WorkloadConfig config;
+    mt19937_64 rng;
+    vector<AccountType> accountTypes;    // by account index
+    vector<uint32_t> popularAccounts;    // every account, most popular first
+    vector<uint32_t> popularDebitable;   // savings and checking, most popular first
+    unique_ptr<ZipfianSampler> anyAccount;
+    unique_ptr<ZipfianSampler> debitableAccount;
+    vector<uint32_t> hits;               // operations naming each account first
+
+    static const char* const firstNames[];
+    static const char* const lastNames[];
+
+    double uniform() { return (rng() >> 11) * 0x1.0p-53; }
+
+    size_t pick(const array<double, 3>& weights) {
+        double total = weights[0] + weights[1] + weights[2];
+        double point = uniform() * total;
+        return point < weights[0] ? 0 : (point < weights[0] + weights[1] ? 1 : 2);
+    }
+
+    // Log-normal around scale times the median amount, via Box-Muller
+    Money drawAmount(double scale = 1) {
+        double normal = sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+        double cents = scale * config.amountMedian.getCents() * exp(config.amountSpread * normal);
+        return Money::fromCents(max<int64_t>(1, llround(min(cents, 1e15))));
+    }
+
+    static AccountHandle handleOf(AccountType type, uint32_t index) { return AccountHandle::make(type, index); }
+
+    AccountHandle draw(const vector<uint32_t>& popular, const ZipfianSampler& sampler) {
+        uint32_t index = popular[sampler.sample(uniform())];
+        return handleOf(accountTypes[index], index);
+    }
+
+    // Plans the accounts: types by the configured mix, popularity by a shuffle
+    void planAccounts() {
+        size_t total = config.customers * config.accountsPerCustomer;
+        accountTypes.reserve(total);
+        static const AccountType types[] = { AccountType::SAVINGS, AccountType::CHECKING, AccountType::LOAN };
+        for (size_t i = 0; i < total; ++i) {
+            accountTypes.push_back(types[pick(config.accountMix)]);
+        }
+        popularAccounts.resize(total);
+        iota(popularAccounts.begin(), popularAccounts.end(), 0);
+        for (size_t i = total; i > 1; --i) {
+            swap(popularAccounts[i - 1], popularAccounts[rng() % i]);
+        }
+        for (uint32_t index : popularAccounts) {
+            if (accountTypes[index] != AccountType::LOAN) {
+                popularDebitable.push_back(index);
+            }
+        }
+        if (total != 0) {
+            anyAccount = make_unique<ZipfianSampler>(popularAccounts.size(), config.skew);
+        }
+        if (!popularDebitable.empty()) {
+            debitableAccount = make_unique<ZipfianSampler>(popularDebitable.size(), config.skew);
+        }
+        hits.assign(total, 0);
+    }
+
+    struct Opening {
+        AccountType type;
+        Money amount;     // opening deposit or loan amount
+        int termMonths;   // loans only
+    };
+
+    // Calls visitor(fields, openings) per customer with its five details and
+    // accounts, drawing both; accounts are numbered in call order
+    template <typename Visitor>
+    void forEachCustomer(Visitor visitor) {
+        static const int terms[] = { 12, 24, 36, 60 };
+        vector<Opening> openings;
+        for (size_t c = 0; c < config.customers; ++c) {
+            string fields[5] = {
+                firstNames[rng() % 16], lastNames[rng() % 32],
+                "customer" + to_string(c) + "@example.com",
+                to_string(5550000000ULL + c),
+                to_string(1 + rng() % 9999) + " Market Street"
+            };
+            openings.clear();
+            for (size_t a = 0; a < config.accountsPerCustomer; ++a) {
+                AccountType type = accountTypes[c * config.accountsPerCustomer + a];
+                if (type == AccountType::LOAN) {
+                    openings.push_back(Opening{ type, drawAmount(200), terms[rng() % 4] });
+                } else {
+                    // Savings must open above their minimum balance
+                    Money deposit = max(drawAmount(40), Money::fromCents(20000));
+                    openings.push_back(Opening{ type, deposit, 0 });
+                }
+            }
+            visitor(fields, openings);
+        }
+    }
+
+    BankRequest nextOperation() {
+        size_t kind = debitableAccount ? pick(config.operationMix) : 0;
+        Money amount = drawAmount();
+        if (kind == 0) {
+            AccountHandle target = draw(popularAccounts, *anyAccount);
+            hits[target.index()]++;
+            return BankRequest::deposit(target, amount);
+        }
+        AccountHandle source = draw(popularDebitable, *debitableAccount);
+        hits[source.index()]++;
+        if (uniform() < config.declineRate) {
+            switch (rng() % 3) {
+                case 0: amount = Money::fromCents(1000000000000LL); break; // more than any balance
+                case 1: amount = Money(); break;                          // rejected as invalid
+                default: source = handleOf(AccountType::SAVINGS, AccountHandle::indexMask); break; // no such account
+            }
+        }
+        return kind == 1 ? BankRequest::withdraw(source, amount)
+                         : BankRequest::transfer(source, draw(popularAccounts, *anyAccount), amount);
+    }
+
+    // Share of the operations that named the most popular 1% of accounts
+    double hottestShare() const {
+        vector<uint32_t> counts(hits);
+        size_t top = max<size_t>(1, counts.size() / 100);
+        if (counts.empty() || config.operations == 0) return 0;
+        nth_element(counts.begin(), counts.begin() + (top - 1), counts.end(), greater<uint32_t>());
+        uint64_t sum = 0;
+        for (size_t i = 0; i < top; ++i) sum += counts[i];
+        return 100.0 * sum / config.operations;
+    }
+
+    void printPlan(ostream& out) const {
+        size_t counts[3] = {};
+        for (AccountType type : accountTypes) counts[static_cast<size_t>(type)]++;
+        out << "customers=" << config.customers << " savings=" << counts[0] << " checking=" << counts[1]
+            << " loans=" << counts[2] << " operations=" << config.operations << " seed=" << config.seed << endl;
+    }
+
+public:
+    explicit WorkloadGenerator(const WorkloadConfig& cfg) : config(cfg), rng(cfg.seed) {
+        if (config.customers == 0 && config.operations != 0) {
+            throw invalid_argument("a workload with operations needs at least one customer");
+        }
+        planAccounts();
+    }
+
+    // Populates the bank and runs the stream against it, reporting throughput,
+    // latency and how the operations ended
+    void run(Bank& bank) {
+        cout << "=== Workload ===" << endl;
+        printPlan(cout);
+
+        vector<AccountHandle> created;
+        created.reserve(accountTypes.size());
+        auto populateStart = chrono::steady_clock::now();
+        forEachCustomer([&](const string* fields, const vector<Opening>& openings) {
+            CustomerHandle customerId = bank.createCustomerHandle(fields[0], fields[1], fields[2], fields[3],
+                                                                  fields[4]);
+            for (const Opening& opening : openings) {
+                switch (opening.type) {
+                    case AccountType::SAVINGS:
+                        created.push_back(bank.createSavingsAccount(customerId, opening.amount));
+                        break;
+                    case AccountType::CHECKING:
+                        created.push_back(bank.createCheckingAccount(customerId, opening.amount));
+                        break;
+                    default:
+                        created.push_back(bank.createLoanAccount(customerId, opening.amount, opening.termMonths));
+                        break;
+                }
+            }
+        });
+        double populateSeconds = chrono::duration<double>(chrono::steady_clock::now() - populateStart).count();
+        cout << "populated in " << fixed << setprecision(3) << populateSeconds << "s" << endl;
+
+        // The stream names accounts by their number in an empty bank; map them
+        // onto the accounts actually created
+        auto actual = [&](AccountHandle planned) {
+            return planned.index() < created.size() ? created[planned.index()] : planned;
+        };
+        array<uint64_t, 5> outcomes{};
+        vector<uint64_t> latencies;
+        size_t stride = max<size_t>(1, config.operations / maxLatencySamples);
+        latencies.reserve(min(config.operations, maxLatencySamples));
+        auto runStart = chrono::steady_clock::now();
+        for (size_t i = 0; i < config.operations; ++i) {
+            BankRequest request = nextOperation();
+            auto start = chrono::steady_clock::now();
+            OperationResult result;
+            if (request.kind == BankRequest::Kind::DEPOSIT) {
+                result = bank.tryDeposit(actual(request.account), request.amount);
+            } else if (request.kind == BankRequest::Kind::WITHDRAW) {
+                result = bank.tryWithdraw(actual(request.account), request.amount);
+            } else {
+                result = bank.tryTransfer(actual(request.account), actual(request.to), request.amount);
+            }
+            if (i % stride == 0) {
+                latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::steady_clock::now() - start).count());
+            }
+            outcomes[static_cast<size_t>(result.status)]++;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+
+        auto percentile = [&](double p) -> uint64_t {
+            if (latencies.empty()) return 0;
+            size_t rank = static_cast<size_t>(p * (latencies.size() - 1));
+            nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+            return latencies[rank];
+        };
+        cout << "ops/sec=" << setprecision(0) << (seconds > 0 ? config.operations / seconds : 0)
+             << " p50=" << percentile(0.50) << "ns p99=" << percentile(0.99) << "ns p99.9="
+             << percentile(0.999) << "ns" << endl;
+        cout << "outcomes:";
+        for (size_t status = 0; status < outcomes.size(); ++status) {
+            cout << ' ' << BankMetrics::outcomeName(static_cast<OperationOutcome>(status)) << '=' << outcomes[status];
+        }
+        cout << endl;
+        cout << "hottest 1% of accounts: " << setprecision(1) << hottestShare() << "% of operations" << endl;
+    }
+
+    // Writes customers, accounts and the stream as a batch script
+    void write(const string& filename) {
+        ofstream out(filename);
+        if (!out.is_open()) {
+            throw runtime_error("cannot write " + filename);
+        }
+        out << "# Synthetic workload; replay into an empty bank with --batch" << endl << "# ";
+        printPlan(out);
+        uint32_t customerIndex = 0;
+        uint32_t accountIndex = 0;
+        forEachCustomer([&](const string* fields, const vector<Opening>& openings) {
+            string customerId = CustomerHandle{ customerIndex++ }.toString();
+            out << "CREATE_CUSTOMER " << fields[0] << ' ' << fields[1] << ' ' << fields[2] << ' '
+                << fields[3] << ' ' << fields[4] << '\n';
+            for (const Opening& opening : openings) {
+                accountIndex++;
+                if (opening.type == AccountType::SAVINGS) {
+                    out << "OPEN_SAVINGS " << customerId << ' ' << opening.amount << '\n';
+                } else if (opening.type == AccountType::CHECKING) {
+                    out << "OPEN_CHECKING " << customerId << ' ' << opening.amount << '\n';
+                } else {
+                    out << "OPEN_LOAN " << customerId << ' ' << opening.amount << ' ' << opening.termMonths << '\n';
+                }
+            }
+        });
+        for (size_t i = 0; i < config.operations; ++i) {
+            BankRequest request = nextOperation();
+            if (request.kind == BankRequest::Kind::DEPOSIT) {
+                out << "DEPOSIT " << request.account.toString() << ' ' << request.amount << '\n';
+            } else if (request.kind == BankRequest::Kind::WITHDRAW) {
+                out << "WITHDRAW " << request.account.toString() << ' ' << request.amount << '\n';
+            } else {
+                out << "TRANSFER " << request.account.toString() << ' ' << request.to.toString() << ' '
+                    << request.amount << '\n';
+            }
+        }
+        out.flush();
+        if (!out) {
+            throw runtime_error("cannot write " + filename);
+        }
+        cout << "Wrote " << config.customers << " customers, " << accountIndex << " accounts and "
+             << config.operations << " operations to " << filename << " (hottest 1% of accounts: "
+             << fixed << setprecision(1) << hottestShare() << "% of operations)" << endl;
+    }
+};
+
+const char* const WorkloadGenerator::firstNames[] = {
+    "Ada", "Alan", "Grace", "Linus", "Barbara", "Edsger", "Frances", "Donald",
+    "Margaret", "Dennis", "Radia", "Ken", "Hedy", "John", "Katherine", "Niklaus"
+};
+
+const char* const WorkloadGenerator::lastNames[] = {
+    "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis",
+    "Rodriguez", "Martinez", "Hernandez", "Lopez", "Gonzalez", "Wilson", "Anderson", "Thomas",
+    "Taylor", "Moore", "Jackson", "Martin", "Lee", "Perez", "Thompson", "White",
+    "Harris", "Sanchez", "Clark", "Ramirez", "Lewis", "Robinson", "Walker", "Young"
+};
+
+// Reads one amount token from the menu input as exact fixed-point money
+Money readAmount(istream& in) {
+    string token;
+    in >> token;
+    Money amount;
+    if (!Money::parse(token, amount)) {
+        throw InvalidAmountException();
+    }
+    return amount;
+}
+
+// Interactive menu-driven interface
+int runInteractiveMenu(Bank& bank) {
+    int choice;
+    string customerId, accountId, fromAccount, toAccount;
+    Money amount;
+    
+    cout << "Welcome to the Bank Management System!" << endl;
+
+    while (true) {
+        try {
+            displayMainMenu();
+            cin >> choice;
+
+            switch (choice) {
+                case 1: {
+                    string firstName, lastName, email, phone, address;
+                    cout << "Enter first name: ";
+                    cin >> firstName;
+                    cout << "Enter last name: ";
+                    cin >> lastName;
+                    cout << "Enter email: ";
+                    cin >> email;
+                    cout << "Enter phone: ";
+                    cin >> phone;
+                    cout << "Enter address: ";
+                    cin.ignore();
+                    getline(cin, address);
+                    
+                    customerId = bank.createCustomer(firstName, lastName, email, phone, address);
+                    break;
+                }
+                case 2: {
+                    cout << "Enter customer ID: ";
+                    cin >> customerId;
+                    cout << "Enter initial deposit: $";
+                    amount = readAmount(cin);
+                    
+                    bank.createSavingsAccount(customerId, amount);
+                    break;
+                }
+                case 3: {
+                    cout << "Enter customer ID: ";
+                    cin >> customerId;
+                    cout << "Enter initial deposit: $";
+                    amount = readAmount(cin);
+                    
+                    bank.createCheckingAccount(customerId, amount);
+                    break;
+                }
+                case 4: {
+                    cout << "Enter customer ID: ";
+                    cin >> customerId;
+                    cout << "Enter loan amount: $";
+                    amount = readAmount(cin);
+                    int term;
+                    cout << "Enter loan term (months): ";
+                    cin >> term;
+                    
+                    bank.createLoanAccount(customerId, amount, term);
+                    break;
+                }
+                case 5: {
+                    cout << "Enter account ID: ";
+                    cin >> accountId;
+                    cout << "Enter deposit amount: $";
+                    amount = readAmount(cin);
+                    
+                    bank.deposit(accountId, amount);
+                    break;
+                }
+                case 6: {
+                    cout << "Enter account ID: ";
+                    cin >> accountId;
+                    cout << "Enter withdrawal amount: $";
+                    amount = readAmount(cin);
+                    
+                    bank.withdraw(accountId, amount);
+                    break;
+                }
+                case 7: {
+                    cout << "Enter from account ID: ";
+                    cin >> fromAccount;
+                    cout << "Enter to account ID: ";
+                    cin >> toAccount;
+                    cout << "Enter transfer amount: $";
+                    amount = readAmount(cin);
+                    
+                    bank.transfer(fromAccount, toAccount, amount);
+                    break;
+                }
+                case 8: {
+                    cout << "Enter customer ID: ";
+                    cin >> customerId;
+                    
+                    auto customer = bank.findCustomer(customerId);
+                    if (customer) {
+                        customer->displayCustomerInfo();
+                    } else {
+                        cout << "Customer not found." << endl;
+                    }
+                    break;
+                }
+                case 9: {
+                    cout << "Enter account ID: ";
+                    cin >> accountId;
+                    
+                    auto account = bank.findAccount(accountId);
+                    if (account) {
+                        account->displayAccountInfo();
+                    } else {
+                        cout << "Account not found." << endl;
+                    }
+                    break;
+                }
+                case 10: {
+                    cout << "Enter customer ID: ";
+                    cin >> customerId;
+                    
+                    bank.displayCustomerAccounts(customerId);
+                    break;
+                }
+                case 11: {
+                    cout << "Enter account ID: ";
+                    cin >> accountId;
+                    
+                    auto account = bank.findAccount(accountId);
+                    if (account) {
+                        account->displayTransactionHistory(bank.getLedger());
+                    } else {
+                        cout << "Account not found." << endl;
+                    }
+                    break;
+                }
+                case 12: {
+                    bank.displayAllCustomers();
+                    break;
+                }
+                case 13: {
+                    bank.displayAllAccounts();
+                    break;
+                }
+                case 14: {
+                    bank.processMonthlyInterest();
+                    break;
+                }
+                case 15: {
+                    bank.generateBankReport();
+                    break;
+                }
+                case 16: {
+                    string filename;
+                    cout << "Enter filename: ";
+                    cin >> filename;
+                    bank.saveToFile(filename);
+                    break;
+                }
+                case 0: {
+                    cout << "Thank you for using Bank Management System!" << endl;
+                    cout << "Goodbye!" << endl;
+                    return 0;
+                }
+                default: {
+                    cout << "Invalid choice. Please try again." << endl;
+                    break;
+                }
+            }
+        }
+        catch (const BankException& e) {
+            cout << "Bank Error: " << e.what() << endl;
+        }
+        catch (const exception& e) {
+            cout << "System Error: " << e.what() << endl;
+        }
+        catch (...) {
+            cout << "Unknown error occurred. Please try again." << endl;
+        }
+
+        // Pause before showing menu again
+        cout << "\nPress Enter to continue...";
+        cin.ignore();
+        cin.get();
+    }
+
+    return 0;
+}
+
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [options] [--batch <file|->] [--bench [customers] [accountsPerCustomer] [operations]]" << endl;
+    cout << "  (no arguments)     interactive menu" << endl;
+    cout << "  --batch <file|->   execute a command script from a file or stdin" << endl;
+    cout << "  --bench ...        time deposit/withdraw/transfer/interest/report on a synthetic bank" << endl;
+    cout << "  --stress [threads] [accounts] [opsPerThread]" << endl;
+    cout << "                     concurrent transfer stress test; fails if money is not conserved" << endl;
+    cout << "  --workload [key=value ...]" << endl;
+    cout << "                     generate seeded synthetic traffic and run it, or write it with out=<file>;" << endl;
+    cout << "                     keys: customers accounts types=S,C,L ops mix=D,W,T amount spread skew decline seed" << endl;
+    cout << "  --serve <address> [workers]" << endl;
+    cout << "                     serve the binary protocol on unix:<path> or [host:]port until SIGINT/SIGTERM" << endl;
+    cout << "  --loadtest <address> [connections] [requestsPerConnection] [depth]" << endl;
+    cout << "                     drive a running server and report requests/sec and latency" << endl;
+    cout << "Options:" << endl;
+    cout << "  --quiet            do not emit account and bank events" << endl;
+    cout << "  --event-log <file> append events to a binary log instead of the console" << endl;
+    cout << "  --load <snapshot>  start from a binary snapshot written by SNAPSHOT" << endl;
+    cout << "  --wal <file>       recover from and append to a write-ahead log (--stress: log the run" << endl;
+    cout << "                     to a new file and check that it recovers)" << endl;
+    cout << "  --commit-delay-us <n>  how long a log flush waits for more operations (default 0)" << endl;
+}
+
+// Main function - interactive menu by default, batch mode on request
+int main(int argc, char* argv[]) {
+    Bank bank("First National Bank");
+    unique_ptr<BankEventSink> eventLog;
+    string walFile;
+    chrono::microseconds commitDelay{ 0 };
+
+    int arg = 1;
+    try {
+        for (; arg < argc; ++arg) {
+            string option = argv[arg];
+            if (option == "--quiet") {
+                BankEvents::setSink(nullptr);
+            } else if (option == "--event-log" && arg + 1 < argc) {
+                eventLog = make_unique<BinaryLogEventSink>(argv[++arg]);
+                BankEvents::setSink(eventLog.get());
+            } else if (option == "--load" && arg + 1 < argc) {
+                bank.loadSnapshot(argv[++arg]);
+            } else if (option == "--wal" && arg + 1 < argc) {
+                walFile = argv[++arg];
+            } else if (option == "--commit-delay-us" && arg + 1 < argc) {
+                commitDelay = chrono::microseconds(stoll(argv[++arg]));
+            } else {
+                break;
+            }
+        }
+
+        // The stress test logs its own bank instead
+        bool stressMode = arg < argc && string(argv[arg]) == "--stress";
+        if (arg < argc && string(argv[arg]) == "--serve") {
+            BankServer::blockStopSignals();
+        }
+        if (!walFile.empty() && !stressMode) {
+            bank.openWriteAheadLog(walFile, commitDelay);
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    int result = 2;
+    int remaining = argc - arg;
+    string mode = remaining > 0 ? argv[arg] : "";
+    if (remaining == 0) {
+        result = runInteractiveMenu(bank);
+    } else if (mode == "--batch" && remaining == 2) {
+        result = runBatch(bank, argv[arg + 1]);
+    } else if (mode == "--bench" && remaining <= 4) {
+        try {
+            BenchmarkConfig config;
+            if (remaining > 1) config.customers = stoull(argv[arg + 1]);
+            if (remaining > 2) config.accountsPerCustomer = stoull(argv[arg + 2]);
+            if (remaining > 3) config.operations = stoull(argv[arg + 3]);
+            BankBenchmark(config).run();
+            result = 0;
+        }
+        catch (const logic_error&) { // a count that is not a number
+            printUsage(argv[0]);
+        }
+        catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            result = 1;
+        }
+    } else if (mode == "--stress" && remaining <= 4) {
+        try {
+            StressConfig config;
+            if (remaining > 1) config.threads = stoull(argv[arg + 1]);
+            if (remaining > 2) config.accounts = max<size_t>(2, stoull(argv[arg + 2]));
+            if (remaining > 3) config.operationsPerThread = stoull(argv[arg + 3]);
+            config.walFile = walFile;
+            config.commitDelay = commitDelay;
+            result = BankStressTest(config).run() ? 0 : 1;
+        }
+        catch (const logic_error&) { // a count that is not a number
+            printUsage(argv[0]);
+        }
+        catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            result = 1;
+        }
+    } else if (mode == "--workload") {
+        if (!eventLog) {
+            BankEvents::setSink(nullptr);
+        }
+        try {
+            WorkloadConfig config;
+            for (int i = arg + 1; i < argc; ++i) {
+                string option = argv[i];
+                size_t equals = option.find('=');
+                if (equals == string::npos) {
+                    throw invalid_argument("workload options are key=value, got '" + option + "'");
+                }
+                config.set(option.substr(0, equals), option.substr(equals + 1));
+            }
+            WorkloadGenerator generator(config);
+            if (config.outputFile.empty()) {
+                generator.run(bank);
+            } else {
+                generator.write(config.outputFile);
+            }
+            result = 0;
+        }
+        catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            result = 1;
+        }
+    } else if (mode == "--serve" && (remaining == 2 || remaining == 3)) {
+        if (!eventLog) {
+            BankEvents::setSink(nullptr); // a console line per request would cost more than the request
+        }
+        try {
+            ServerConfig config;
+            config.address = argv[arg + 1];
+            if (remaining > 2) config.workers = max<size_t>(1, stoull(argv[arg + 2]));
+            BankServer(bank, config).run();
+            result = 0;
+        }
+        catch (const logic_error&) { // a count that is not a number
+            printUsage(argv[0]);
+        }
+        catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            result = 1;
+        }
+    } else if (mode == "--loadtest" && remaining >= 2 && remaining <= 5) {
+        try {
+            LoadTestConfig config;
+            config.address = argv[arg + 1];
+            if (remaining > 2) config.connections = stoull(argv[arg + 2]);
+            if (remaining > 3) config.requestsPerConnection = stoull(argv[arg + 3]);
+            if (remaining > 4) config.depth = stoull(argv[arg + 4]);
+            BankLoadTest(config).run();
+            result = 0;
+        }
+        catch (const logic_error&) { // a count that is not a number
+            printUsage(argv[0]);
+        }
+        catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            result = 1;
+        }
+    } else {
+        printUsage(argv[0]);
+    }
+
+    BankEvents::setSink(nullptr);
+    return result;
+}